@@ -8,8 +8,46 @@ public:
 	virtual std::uint8_t readByte(std::uint32_t address) = 0;
 	virtual void writeByte(std::uint32_t address, std::uint8_t val) = 0;
 
+	/**
+	 * Reads a little endian 16 bit value from address and address + 1.
+	*/
+	virtual std::uint16_t readWord(std::uint32_t address)
+	{
+		return readByte(address) | (readByte(address + 1) << 8);
+	}
+
+	/**
+	 * Reads or writes length bytes starting at address, as readByte and writeByte would.
+	*/
+	virtual void readBlock(std::uint32_t address, std::uint8_t* dest, std::uint32_t length)
+	{
+		for (std::uint32_t i = 0; i < length; ++i) {
+			dest[i] = readByte(address + i);
+		}
+	}
+
+	virtual void writeBlock(std::uint32_t address, const std::uint8_t* src, std::uint32_t length)
+	{
+		for (std::uint32_t i = 0; i < length; ++i) {
+			writeByte(address + i, src[i]);
+		}
+	}
+
 	/**
 	 * sets a value, bypassing any write handlers. Useful for setting a read value when a write handler is set to the same address.
 	*/
 	virtual void setByte(std::uint32_t address, std::uint8_t val) = 0;
+
+	/**
+	 * True if reading address runs a handler rather than reading memory, so the value can
+	 * change, or the read have side effects, without anything writing to it.
+	*/
+	virtual bool hasReadHandler(std::uint32_t /*address*/) const { return false; }
+
+	/**
+	 * The host memory behind a 256 byte page, if reads and writes there always go
+	 * straight to that memory, otherwise nullptr. A cpu may keep the pointer and use it
+	 * in place of the bus until the memory map next changes.
+	*/
+	virtual std::uint8_t* plainMemoryPage(std::uint32_t /*page*/) { return nullptr; }
 };
\ No newline at end of file
@@ -0,0 +1,162 @@
+#include "collision_detector.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define COLLISION_SSE2
+#endif
+
+static const int SCREEN_SIZE = SpriteLayer::SCREEN_SIZE;
+
+// Rounds down rather than towards zero, for sprites hanging off the left of the screen.
+static int floorDiv8(int value)
+{
+	return value >= 0 ? value / 8 : (value - 7) / 8;
+}
+
+// Returns a mask of the rows, bit 0 for row 0, in which a and b share a set bit.
+static std::uint32_t overlappingRows(const std::uint32_t* a, const std::uint32_t* b)
+{
+	std::uint32_t found = 0;
+#ifdef COLLISION_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	for (int row = 0; row < SpriteLayer::SPRITE_SIZE; row += 4) {
+		__m128i both = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + row)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + row)));
+		int empty = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(both, zero)));
+		found |= static_cast<std::uint32_t>(~empty & 0x0F) << row;
+	}
+#else
+	for (int row = 0; row < SpriteLayer::SPRITE_SIZE; ++row) {
+		if ((a[row] & b[row]) != 0) {
+			found |= 1u << row;
+		}
+	}
+#endif
+	return found;
+}
+
+// Fills in found with the first set pixel, in beam order, of a and b, given that rows has
+// at least one bit set and the words start at column left on screen row top.
+static void firstOverlap(const std::uint32_t* a, const std::uint32_t* b, std::uint32_t rows, int left, int top, CollisionDetector::Collision& found)
+{
+	int row = 0;
+	while ((rows & (1u << row)) == 0) {
+		++row;
+	}
+	std::uint32_t both = a[row] & b[row];
+	int col = 0;
+	while ((both & (0x80000000u >> col)) == 0) {
+		++col;
+	}
+	found.hit = true;
+	found.x = left + col;
+	found.y = top + row;
+}
+
+CollisionDetector::CollisionDetector(const std::uint8_t* rom, std::uint32_t romSize)
+	: numSprites(static_cast<int>(romSize / 32))
+	, rows(numSprites * ROWS)
+{
+	for (int sprite = 0; sprite < numSprites; ++sprite) {
+		const std::uint8_t* bits = rom + sprite * 32;
+		for (int row = 0; row < ROWS; ++row) {
+			rows[sprite * ROWS + row] = static_cast<std::uint16_t>((bits[row] << 8) | bits[row + 16]);
+		}
+	}
+}
+
+std::uint8_t CollisionDetector::check(const SpriteLayer& sprites, const std::uint8_t* charCodes, const std::uint8_t* charBits, Collision (&found)[NUM_COLLISIONS]) const
+{
+	for (auto& collision : found) {
+		collision = Collision();
+	}
+	if (numSprites == 0) {
+		return 0;
+	}
+	// A hidden sprite collides with nothing.
+	if (sprites.visible(0)) {
+		checkBackground(sprites.screenX(0), sprites.screenY(0), sprites.code(0), charCodes, charBits, found[SPRITE1_BACKGROUND]);
+		checkSprites(sprites, found[SPRITE1_SPRITE2]);
+	}
+	checkBackground(sprites.screenX(1), sprites.screenY(1), sprites.code(1), charCodes, charBits, found[SPRITE2_BACKGROUND]);
+
+	std::uint8_t status = 0;
+	for (int collision = 0; collision < NUM_COLLISIONS; ++collision) {
+		if (found[collision].hit) {
+			status |= statusBit(collision);
+		}
+	}
+	return status;
+}
+
+bool CollisionDetector::checkBackground(int x, int y, int code, const std::uint8_t* charCodes, const std::uint8_t* charBits, Collision& found) const
+{
+	// The four cells from the one the sprite starts in, so the sprite sits in the top
+	// 8 + 15 bits of each word.
+	const int firstCell = floorDiv8(x);
+	const int shift = 16 - (x - firstCell * 8);
+	// The cells of the four that are on the screen.
+	const int fromCell = firstCell < 0 ? -firstCell : 0;
+	const int toCell = firstCell + 4 > SCREEN_SIZE / 8 ? SCREEN_SIZE / 8 - firstCell : 4;
+	std::uint32_t sprite[ROWS];
+	std::uint32_t background[ROWS];
+	for (int row = 0; row < ROWS; ++row) {
+		int screenY = y + row;
+		sprite[row] = static_cast<std::uint32_t>(spriteRow(code, row)) << shift;
+		background[row] = 0;
+		if (screenY < 0 || screenY >= SCREEN_SIZE) {
+			continue;
+		}
+		const int codes = (screenY / 8) * (SCREEN_SIZE / 8) + firstCell;
+		const std::uint8_t* glyphRows = charBits + (screenY & 7);
+		for (int cell = fromCell; cell < toCell; ++cell) {
+			background[row] |= static_cast<std::uint32_t>(glyphRows[charCodes[codes + cell] * 8]) << (24 - cell * 8);
+		}
+	}
+	std::uint32_t hitRows = overlappingRows(sprite, background);
+	if (hitRows == 0) {
+		return false;
+	}
+	firstOverlap(sprite, background, hitRows, firstCell * 8, y, found);
+	return true;
+}
+
+bool CollisionDetector::checkSprites(const SpriteLayer& sprites, Collision& found) const
+{
+	int x1 = sprites.screenX(0);
+	int y1 = sprites.screenY(0);
+	int x2 = sprites.screenX(1);
+	int y2 = sprites.screenY(1);
+	if (x1 - x2 >= ROWS || x2 - x1 >= ROWS || y1 - y2 >= ROWS || y2 - y1 >= ROWS) {
+		return false;
+	}
+
+	// Words start at the leftmost sprite and rows at the topmost, and only pixels on the
+	// screen count.
+	const int left = x1 < x2 ? x1 : x2;
+	const int top = y1 < y2 ? y1 : y2;
+	std::uint32_t onScreen = left < 0 ? 0xFFFFFFFFu >> -left : 0xFFFFFFFFu;
+	if (left > SCREEN_SIZE - 32) {
+		onScreen &= ~(0xFFFFFFFFu >> (SCREEN_SIZE - left));
+	}
+	std::uint32_t sprite1[ROWS];
+	std::uint32_t sprite2[ROWS];
+	for (int row = 0; row < ROWS; ++row) {
+		int screenY = top + row;
+		sprite1[row] = sprite2[row] = 0;
+		if (screenY < 0 || screenY >= SCREEN_SIZE) {
+			continue;
+		}
+		if (screenY >= y1 && screenY - y1 < ROWS) {
+			sprite1[row] = (static_cast<std::uint32_t>(spriteRow(sprites.code(0), screenY - y1)) << (16 - (x1 - left))) & onScreen;
+		}
+		if (screenY >= y2 && screenY - y2 < ROWS) {
+			sprite2[row] = (static_cast<std::uint32_t>(spriteRow(sprites.code(1), screenY - y2)) << (16 - (x2 - left))) & onScreen;
+		}
+	}
+	std::uint32_t hitRows = overlappingRows(sprite1, sprite2);
+	if (hitRows == 0) {
+		return false;
+	}
+	firstOverlap(sprite1, sprite2, hitRows, left, top, found);
+	return true;
+}
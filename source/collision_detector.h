@@ -0,0 +1,54 @@
+#pragma once
+
+#include "sprite_layer.h"
+#include <cstdint>
+#include <vector>
+
+/*
+Finds where the two sprites of an Exidy board overlap the character layer or each other,
+the way the board's collision circuits do as the beam draws them. Everything is worked out
+on 1bpp row masks: each sprite row and the character bits under it are put into 32 bit
+words covering the same columns, so a sprite is tested with a few vector ANDs rather than
+pixel by pixel.
+*/
+class CollisionDetector
+{
+public:
+	// Which collision, as an index into the found array of check and as a status bit.
+	static const int SPRITE1_BACKGROUND = 0;
+	static const int SPRITE2_BACKGROUND = 1;
+	static const int SPRITE1_SPRITE2 = 2;
+	static const int NUM_COLLISIONS = 3;
+
+	static std::uint8_t statusBit(int collision) { return static_cast<std::uint8_t>(0x04 << collision); }
+
+	class Collision
+	{
+	public:
+		bool hit = false;
+		// The first pixel of the collision in beam order.
+		int x = 0;
+		int y = 0;
+	};
+
+	// rom is the sprite ROM, laid out as for SpriteLayer.
+	CollisionDetector(const std::uint8_t* rom, std::uint32_t romSize);
+
+	/**
+	 * Checks the visible sprites where sprites has them against each other and against the
+	 * character layer, given as the 32x32 character codes and the generator's 8 bytes per
+	 * glyph. Fills in found for each collision and returns their status bits.
+	*/
+	std::uint8_t check(const SpriteLayer& sprites, const std::uint8_t* charCodes, const std::uint8_t* charBits, Collision (&found)[NUM_COLLISIONS]) const;
+
+private:
+	static const int ROWS = SpriteLayer::SPRITE_SIZE;
+
+	bool checkBackground(int x, int y, int code, const std::uint8_t* charCodes, const std::uint8_t* charBits, Collision& found) const;
+	bool checkSprites(const SpriteLayer& sprites, Collision& found) const;
+	// The pixels of a row of a sprite, bit 15 leftmost.
+	std::uint16_t spriteRow(int code, int row) const { return rows[code * ROWS + row]; }
+
+	int numSprites;
+	std::vector<std::uint16_t> rows;
+};
@@ -1,7 +1,13 @@
 #include "m6502.h"
+#include "../direct_address_bus.h"
+#if defined(M6502_JIT)
+#include "m6502_jit.h"
+#endif
 #include <iostream>
 #include <sstream>
 #include <iomanip>
+#include <algorithm>
+#include <limits>
 
 static void formatImmediateInstruction(std::ostringstream& os, const char* opcode, int immVal)
 {
@@ -79,9 +85,10 @@ static void formatIndirectYInstruction(std::ostringstream& os, const char* opcod
 }
 
 
-m6502::OpcodeDesc m6502::disassemble(unsigned short pc, DebugInfo& debugInfo)
+template <class Bus>
+typename m6502Core<Bus>::OpcodeDesc m6502Core<Bus>::disassemble(unsigned short pc, DebugInfo& debugInfo)
 {
-	m6502::OpcodeDesc desc;
+	OpcodeDesc desc;
 	desc.numBytes = 1;
 
 	int opcode = addressBus.readByte(pc);
@@ -408,29 +415,376 @@ m6502::OpcodeDesc m6502::disassemble(unsigned short pc, DebugInfo& debugInfo)
 	return desc;
 }
 
-void m6502::reset()
+/*
+Decimal mode ADC and SBC, worked out once for every carry, A and operand. Each entry has
+the result in the low byte and the N, V, Z and C bits of P in the high byte.
+
+The NMOS 6502 only gets the accumulator and carry right in decimal mode. For ADC, N and V
+come from the sum after the low nibble has been adjusted and Z from the binary sum; for
+SBC all of the flags are those of the binary subtraction. These follow the sequences in
+Bruce Clark's decimal mode tutorial.
+*/
+static std::uint16_t decimalADC(int a, int b, int carry)
+{
+	int low = (a & 0x0F) + (b & 0x0F) + carry;
+	if (low >= 0x0A) {
+		low = ((low + 0x06) & 0x0F) + 0x10;
+	}
+	int sum = (a & 0xF0) + (b & 0xF0) + low;
+	int signedSum = static_cast<std::int8_t>(a & 0xF0) + static_cast<std::int8_t>(b & 0xF0) + low;
+
+	std::uint8_t flags = sum & 0x80;
+	if (signedSum < -128 || signedSum > 127) {
+		flags |= 0x40;
+	}
+	if (((a + b + carry) & 0xFF) == 0) {
+		flags |= 0x02;
+	}
+	if (sum >= 0xA0) {
+		sum += 0x60;
+	}
+	if (sum >= 0x100) {
+		flags |= 0x01;
+	}
+	return (flags << 8) | (sum & 0xFF);
+}
+
+static std::uint16_t decimalSBC(int a, int b, int carry)
+{
+	int binary = a - b - (1 - carry);
+	std::uint8_t flags = binary & 0x80;
+	if (((a ^ b) & (a ^ binary) & 0x80) != 0) {
+		flags |= 0x40;
+	}
+	if ((binary & 0xFF) == 0) {
+		flags |= 0x02;
+	}
+	if (binary >= 0) {
+		flags |= 0x01;
+	}
+
+	int low = (a & 0x0F) - (b & 0x0F) + carry - 1;
+	if (low < 0) {
+		low = ((low - 0x06) & 0x0F) - 0x10;
+	}
+	int result = (a & 0xF0) - (b & 0xF0) + low;
+	if (result < 0) {
+		result -= 0x60;
+	}
+	return (flags << 8) | (result & 0xFF);
+}
+
+class DecimalTables
+{
+public:
+	DecimalTables()
+	{
+		for (int carry = 0; carry < 2; ++carry) {
+			for (int a = 0; a < 256; ++a) {
+				for (int b = 0; b < 256; ++b) {
+					adc[carry][a][b] = decimalADC(a, b, carry);
+					sbc[carry][a][b] = decimalSBC(a, b, carry);
+				}
+			}
+		}
+	}
+
+	// Indexed by carry, A and then the operand.
+	std::uint16_t adc[2][256][256];
+	std::uint16_t sbc[2][256][256];
+};
+
+static const DecimalTables decimalTables;
+
+template <class Bus>
+const typename m6502Core<Bus>::OpcodeInfo m6502Core<Bus>::opcodeTable[256] = {
+#define M6502_OPCODE(opcode, length, cycles, handler) { &handler, length, cycles },
+#include "m6502_opcodes.h"
+#undef M6502_OPCODE
+};
+
+template <class Bus>
+void m6502Core<Bus>::reset()
 {
-	regPC = addressBus.readByte(0xFFFD) * 256 + addressBus.readByte(0xFFFC);
+	regPC = addressBus.readWord(0xFFFC);
 	irqLine = true;
-	interruptDisable = true;
+	setInterruptDisable(true);
 	cycleCount = 0;
+	mapFastPages();
+}
+
+template <class Bus>
+void m6502Core<Bus>::mapFastPages()
+{
+	zeroPage = cacheablePages[0] ? nullptr : addressBus.plainMemoryPage(0);
+	stackPage = cacheablePages[1] ? nullptr : addressBus.plainMemoryPage(1);
+}
+
+template <class Bus>
+std::uint16_t m6502Core<Bus>::fetchOperand(std::uint16_t pc, int length)
+{
+	if (length > 2) {
+		return addressBus.readWord(pc + 1);
+	}
+	if (length > 1) {
+		return addressBus.readByte(pc + 1);
+	}
+	return 0;
+}
+
+template <class Bus>
+void m6502Core<Bus>::decode(std::uint16_t pc, DecodedInstruction& insn)
+{
+	insn.opcode = addressBus.readByte(pc);
+	const OpcodeInfo& op = opcodeTable[insn.opcode];
+	insn.handler = op.handler;
+	insn.pc = pc;
+	insn.length = op.length;
+	insn.cycles = op.cycles;
+	insn.operand = fetchOperand(pc, op.length);
+	insn.idleCycles = 0;
+}
+
+static bool endsBlock(std::uint8_t opcode)
+{
+	// Relative branches, BRK, JSR, RTI, JMP, RTS and JMP ($nnnn)
+	return (opcode & 0x1F) == 0x10 || opcode == 0x00 || opcode == 0x20 || opcode == 0x40 ||
+		opcode == 0x4c || opcode == 0x60 || opcode == 0x6c;
+}
+
+static const int MAX_BLOCK_INSTRUCTIONS = 64;
+
+template <class Bus>
+template <std::uint8_t (m6502Core<Bus>::*Read)(std::uint16_t)>
+bool m6502Core<Bus>::isPlainRead(OpHandler handler)
+{
+	return handler == &opRead<Read, &m6502Core::doLDA> || handler == &opRead<Read, &m6502Core::doLDX> ||
+		handler == &opRead<Read, &m6502Core::doLDY> || handler == &opRead<Read, &m6502Core::doCMP> ||
+		handler == &opRead<Read, &m6502Core::doCPX> || handler == &opRead<Read, &m6502Core::doCPY> ||
+		handler == &opRead<Read, &m6502Core::doBIT>;
+}
+
+/*
+Loads, compares and BIT without indexing: they read memory and set registers and
+flags from what they read, and always take the same number of cycles. Which opcodes
+those are is worked out from the handlers in the opcode table, so an opcode only
+counts once it is implemented.
+*/
+template <class Bus>
+bool m6502Core<Bus>::readsOnly(std::uint8_t opcode)
+{
+	static const std::vector<bool> table = [] {
+		std::vector<bool> readOnly(256);
+		for (int i = 0; i < 256; ++i) {
+			OpHandler handler = opcodeTable[i].handler;
+			readOnly[i] = handler == &opNop || isPlainRead<&m6502Core::readImmediate>(handler) ||
+				isPlainRead<&m6502Core::readZeroPageValue>(handler) || isPlainRead<&m6502Core::readAbsolute>(handler);
+		}
+		return readOnly;
+	}();
+	return table[opcode];
+}
+
+template <class Bus>
+bool m6502Core<Bus>::readsHandler(const DecodedInstruction& insn)
+{
+	// Bits 2 to 4 of the opcode give the addressing mode.
+	switch (insn.opcode & 0x1C)
+	{
+		case 0x04:
+			return addressBus.hasReadHandler(insn.operand & 0xFF);
+		case 0x0C:
+			return addressBus.hasReadHandler(insn.operand);
+		default:
+			return false;
+	}
+}
+
+template <class Bus>
+const typename m6502Core<Bus>::DecodedInstruction& m6502Core<Bus>::fetch()
+{
+	if (!retiredBlocks.empty()) {
+		retiredBlocks.clear();
+	}
+	if (nextDecoded != nullptr && nextDecoded->pc == regPC) {
+		const DecodedInstruction& insn = *nextDecoded++;
+		if (nextDecoded == decodedBlockEnd) {
+			nextDecoded = nullptr;
+		}
+		return insn;
+	}
+	nextDecoded = nullptr;
+	if (cacheablePages[regPC >> 8]) {
+		return fetchBlock();
+	}
+	idleLoopPC = -1;
+	decode(regPC, uncachedInstruction);
+	return uncachedInstruction;
+}
+
+template <class Bus>
+const std::vector<typename m6502Core<Bus>::DecodedInstruction>& m6502Core<Bus>::decodeBlock(std::uint16_t startPC)
+{
+	auto found = decodedBlocks.find(startPC);
+	if (found != decodedBlocks.end()) {
+		return found->second;
+	}
+
+	std::vector<DecodedInstruction> block;
+	std::uint16_t pc = startPC;
+	DecodedInstruction insn;
+	do {
+		decode(pc, insn);
+		block.push_back(insn);
+		pc += insn.length;
+	} while (insn.length != 0 && !endsBlock(insn.opcode) && cacheablePages[pc >> 8] &&
+		block.size() < MAX_BLOCK_INSTRUCTIONS);
+
+	/*
+	A block that only reads memory and then branches or jumps back to its own start is
+	an idle loop. Once a pass round it has left the registers and flags as they were,
+	every further pass will too until something outside the cpu changes memory or the
+	irq line, so the time for a pass is kept to skip ahead by. A read that goes to a bus
+	read handler is not memory and can change on every pass, so it rules a loop out.
+	Handlers can be added after the block is decoded, so that is checked again when skipping.
+	*/
+	const DecodedInstruction& last = block.back();
+	int loopCycles = -1;
+	if (last.opcode == 0x4c && last.operand == startPC) {
+		loopCycles = last.cycles;
+	}
+	else if ((last.opcode & 0x1F) == 0x10) {
+		std::uint16_t nextPC = last.pc + last.length;
+		std::uint16_t targetPC = nextPC + static_cast<std::int8_t>(last.operand);
+		if (targetPC == startPC) {
+			loopCycles = last.cycles + ((targetPC & 0xFF00) != (nextPC & 0xFF00) ? 2 : 1);
+		}
+	}
+	if (loopCycles > 0) {
+		for (auto insn = block.begin(); insn + 1 != block.end(); ++insn) {
+			if (!readsOnly(insn->opcode) || readsHandler(*insn)) {
+				loopCycles = -1;
+				break;
+			}
+			loopCycles += insn->cycles;
+		}
+		if (loopCycles > 0 && loopCycles < 256) {
+			block.front().idleCycles = loopCycles;
+		}
+	}
+
+	// A block can run into the next page so register it with every page it touches.
+	for (const auto& decoded : block) {
+		int firstPage = decoded.pc >> 8;
+		int lastPage = ((decoded.pc + (decoded.length > 0 ? decoded.length - 1 : 0)) >> 8) & 0xFF;
+		for (int page : { firstPage, lastPage }) {
+			if (pageBlocks[page].empty() || pageBlocks[page].back() != startPC) {
+				pageBlocks[page].push_back(startPC);
+			}
+			cachedPages[page] = true;
+		}
+	}
+	return decodedBlocks.emplace(startPC, std::move(block)).first->second;
+}
+
+template <class Bus>
+const typename m6502Core<Bus>::DecodedInstruction& m6502Core<Bus>::fetchBlock()
+{
+	const std::vector<DecodedInstruction>& block = decodeBlock(regPC);
+	if (block.front().idleCycles != 0) {
+		skipIdleLoop(block);
+	}
+	else {
+		idleLoopPC = -1;
+	}
+	if (block.size() > 1) {
+		nextDecoded = block.data() + 1;
+		decodedBlockEnd = block.data() + block.size();
+	}
+	return block.front();
+}
+
+template <class Bus>
+std::uint64_t m6502Core<Bus>::idleLoopState() const
+{
+	return regA | (regX << 8) | (regY << 16) | (static_cast<std::uint64_t>(regSP) << 24) |
+		(static_cast<std::uint64_t>(getP()) << 32);
+}
+
+template <class Bus>
+void m6502Core<Bus>::skipIdleLoop(const std::vector<DecodedInstruction>& block)
+{
+	const DecodedInstruction& first = block.front();
+	std::uint64_t state = idleLoopState();
+	// Breakpoints and tracing need to see every pass.
+	if (idleLoopPC == regPC && idleLoopEntryState == state && pendingWork == 0 &&
+		std::none_of(block.begin(), block.end(), [this](const DecodedInstruction& insn) { return readsHandler(insn); })) {
+		// Nothing changed in the last pass, so skip every whole pass that ends before
+		// the target and leave the rest to run normally.
+		std::int64_t passes = (idleSkipTarget - cycleCount - 1) / first.idleCycles;
+		if (passes > 0) {
+			cycleCount += passes * first.idleCycles;
+		}
+	}
+	idleLoopPC = regPC;
+	idleLoopEntryState = state;
 }
 
-std::uint16_t m6502::getIndexedIndirectAddress()
+template <class Bus>
+void m6502Core<Bus>::enableCodeCache(std::uint16_t start, std::uint16_t end)
 {
-	std::uint8_t nn = addressBus.readByte(regPC+1);
-	std::uint8_t zPageAddr = nn + regX;
-	std::uint8_t lo = addressBus.readByte(zPageAddr);
-	std::uint8_t hi = addressBus.readByte(zPageAddr+1);		// Unsure if this should wrap to the zero page.
-	return (hi << 8) | lo;
+	for (int page = start >> 8; page <= (end >> 8); ++page) {
+		cacheablePages[page] = true;
+	}
+	mapFastPages();
+}
+
+template <class Bus>
+void m6502Core<Bus>::invalidateCodeCache(std::uint16_t address)
+{
+	int page = address >> 8;
+	if (!cachedPages[page]) {
+		return;
+	}
+	// The instruction doing the write may be in one of these blocks, so they are kept
+	// until the next fetch rather than freed under it.
+	for (auto blockPC : pageBlocks[page]) {
+		auto found = decodedBlocks.find(blockPC);
+		if (found != decodedBlocks.end()) {
+			retiredBlocks.push_back(std::move(found->second));
+			decodedBlocks.erase(found);
+		}
+	}
+	pageBlocks[page].clear();
+	cachedPages[page] = false;
+	nextDecoded = nullptr;
+	idleLoopPC = -1;
+#if defined(M6502_JIT)
+	jit->invalidatePage(page);
+#endif
+}
+
+template <class Bus>
+void m6502Core<Bus>::writeByte(std::uint16_t address, std::uint8_t val)
+{
+	addressBus.writeByte(address, val);
+	if (cachedPages[address >> 8]) {
+		invalidateCodeCache(address);
+	}
+}
+
+template <class Bus>
+std::uint16_t m6502Core<Bus>::getIndexedIndirectAddress(std::uint16_t operand)
+{
+	std::uint8_t zPageAddr = operand + regX;
+	return readZeroPageWord(zPageAddr);		// Unsure if this should wrap to the zero page.
 }
 
-std::uint16_t m6502::getIndirectIndexedYAddress()
+template <class Bus>
+std::uint16_t m6502Core<Bus>::getIndirectIndexedYAddress(std::uint16_t operand)
 {
-	std::uint8_t zPageAddr = addressBus.readByte(regPC + 1);
-	std::uint8_t lo = addressBus.readByte(zPageAddr);
-	std::uint8_t hi = addressBus.readByte(zPageAddr + 1);		// Unsure if this should wrap to the zero page.
-	std::uint16_t indirectAddr = (hi << 8) | lo;
+	std::uint8_t zPageAddr = operand;
+	std::uint16_t indirectAddr = readZeroPageWord(zPageAddr);		// Unsure if this should wrap to the zero page.
 	std::uint16_t readAddr = indirectAddr + regY;
 	if ((indirectAddr >> 8) != (readAddr >> 8)) {
 		// pay the penalty for carry addition
@@ -440,252 +794,297 @@ std::uint16_t m6502::getIndirectIndexedYAddress()
 	return readAddr;
 }
 
-std::uint8_t m6502::readIndexedIndirect()
+template <class Bus>
+std::uint8_t m6502Core<Bus>::readIndexedIndirect(std::uint16_t operand)
 {
 	// e.g. OPCODE ($nn,X)
-	std::uint16_t addr = getIndexedIndirectAddress();
+	std::uint16_t addr = getIndexedIndirectAddress(operand);
 	return addressBus.readByte(addr);
 }
 
-void m6502::writeIndexedIndirect(std::uint8_t val)
+template <class Bus>
+void m6502Core<Bus>::writeIndexedIndirect(std::uint16_t operand, std::uint8_t val)
 {
 	// e.g. OPCODE ($nn,X)
-	std::uint16_t addr = getIndexedIndirectAddress();
-	addressBus.writeByte(addr, val);
+	std::uint16_t addr = getIndexedIndirectAddress(operand);
+	writeByte(addr, val);
 }
 
-std::uint8_t m6502::readIndirectIndexedY()
+template <class Bus>
+std::uint8_t m6502Core<Bus>::readIndirectIndexedY(std::uint16_t operand)
 {
 	// e.g. OPCODE ($nn),Y
-	std::uint16_t addr = getIndirectIndexedYAddress();
+	std::uint16_t addr = getIndirectIndexedYAddress(operand);
 	return addressBus.readByte(addr);
 }
 
-void m6502::writeIndirectIndexedY(std::uint8_t val)
+template <class Bus>
+void m6502Core<Bus>::writeIndirectIndexedY(std::uint16_t operand, std::uint8_t val)
 {
 	// e.g. OPCODE ($nn), Y
-	std::uint16_t addr = getIndirectIndexedYAddress();
-	addressBus.writeByte(addr, val);
+	std::uint16_t addr = getIndirectIndexedYAddress(operand);
+	writeByte(addr, val);
 }
 
-std::uint8_t m6502::readAbsolute()
+template <class Bus>
+std::uint8_t m6502Core<Bus>::readAbsolute(std::uint16_t operand)
 {
-	std::uint16_t addr = addressBus.readByte(regPC + 1) + (addressBus.readByte(regPC + 2) << 8);
-	return addressBus.readByte(addr);
+	return addressBus.readByte(operand);
 }
 
-void m6502::writeAbsolute(std::uint8_t val)
+template <class Bus>
+void m6502Core<Bus>::writeAbsolute(std::uint16_t operand, std::uint8_t val)
 {
-	std::uint16_t addr = addressBus.readByte(regPC + 1) + (addressBus.readByte(regPC + 2) << 8);
-	addressBus.writeByte(addr, val);
+	writeByte(operand, val);
 }
 
-std::uint8_t m6502::readAbsoluteX()
+template <class Bus>
+std::uint8_t m6502Core<Bus>::readAbsoluteX(std::uint16_t operand)
 {
 	// e.g. OPCODE $nn, X
-	std::uint16_t addr = addressBus.readByte(regPC + 1) + (addressBus.readByte(regPC + 2) << 8);
-	std::uint16_t readAddr = addr + regX;
-	if ((addr >> 8) != (readAddr >> 8)) {
+	std::uint16_t readAddr = operand + regX;
+	if ((operand >> 8) != (readAddr >> 8)) {
 		// pay the penalty for carry addition
 		cycleCount += 1;
 	}
 	return addressBus.readByte(readAddr);
 }
 
-std::uint8_t m6502::readAbsoluteY()
+template <class Bus>
+std::uint8_t m6502Core<Bus>::readAbsoluteY(std::uint16_t operand)
 {
 	// e.g. OPCODE $nn, Y
-	std::uint16_t addr = addressBus.readByte(regPC + 1) + (addressBus.readByte(regPC + 2) << 8);
-	std::uint16_t readAddr = addr + regY;
-	if ((addr >> 8) != (readAddr >> 8)) {
+	std::uint16_t readAddr = operand + regY;
+	if ((operand >> 8) != (readAddr >> 8)) {
 		// pay the penalty for carry addition
 		cycleCount += 1;
 	}
 	return addressBus.readByte(readAddr);
 }
 
-void m6502::writeAbsoluteY(std::uint8_t val)
+template <class Bus>
+void m6502Core<Bus>::writeAbsoluteY(std::uint16_t operand, std::uint8_t val)
 {
-	std::uint16_t addr = addressBus.readByte(regPC + 1) + (addressBus.readByte(regPC + 2) << 8) + regY;
-	addressBus.writeByte(addr, val);
+	std::uint16_t addr = operand + regY;
+	writeByte(addr, val);
 }
 
-std::uint8_t m6502::readZeroPageValue()
+template <class Bus>
+std::uint8_t m6502Core<Bus>::readZeroPageValue(std::uint16_t operand)
 {
 	// e.g. OPCODE $nn
-	std::uint8_t zPageAddr = addressBus.readByte(regPC + 1);
-	return addressBus.readByte(zPageAddr);
+	return readZeroPage(operand & 0xFF);
 }
 
-std::uint8_t m6502::readZeroPageXValue()
+template <class Bus>
+std::uint8_t m6502Core<Bus>::readZeroPageXValue(std::uint16_t operand)
 {
-	std::uint8_t zPageAddr = addressBus.readByte(regPC + 1);
-	std::uint8_t zPageXAddr = zPageAddr + regX;
-	return addressBus.readByte(zPageXAddr);
+	return readZeroPage((operand + regX) & 0xFF);
 }
 
-void m6502::writeZeroPageValue(std::uint8_t val)
+template <class Bus>
+void m6502Core<Bus>::writeZeroPageValue(std::uint16_t operand, std::uint8_t val)
 {
-	std::uint8_t zPageAddr = addressBus.readByte(regPC + 1);
-	addressBus.writeByte(zPageAddr, val);
+	writeZeroPage(operand & 0xFF, val);
 }
 
-void m6502::writeZeroPageXValue(std::uint8_t val)
+template <class Bus>
+void m6502Core<Bus>::writeZeroPageXValue(std::uint16_t operand, std::uint8_t val)
 {
-	std::uint8_t zPageAddr = addressBus.readByte(regPC + 1);
-	std::uint8_t zPageXAddr = zPageAddr + regX;
-	addressBus.writeByte(zPageXAddr, val);
+	writeZeroPage((operand + regX) & 0xFF, val);
 }
 
-void m6502::pushByte(std::uint8_t val)
+template <class Bus>
+void m6502Core<Bus>::pushByte(std::uint8_t val)
 {
-	std::uint16_t addr = regSP + 0x100;
-	addressBus.writeByte(addr, val);
+	if (stackPage != nullptr) {
+		stackPage[regSP] = val;
+	}
+	else {
+		writeByte(regSP + 0x100, val);
+	}
 	regSP -= 1;
 }
 
-void m6502::pushShort(std::uint16_t val)
+template <class Bus>
+void m6502Core<Bus>::pushShort(std::uint16_t val)
 {
 	pushByte((val >> 8) & 0xFF);
 	pushByte(val & 0xFF);
 }
 
-std::uint8_t m6502::popByte()
+template <class Bus>
+std::uint8_t m6502Core<Bus>::popByte()
 {
 	regSP += 1;
-	std::uint16_t addr = regSP + 0x100;
-	return addressBus.readByte(addr);
+	return stackPage != nullptr ? stackPage[regSP] : addressBus.readByte(regSP + 0x100);
 }
 
-std::uint16_t m6502::popShort()
+template <class Bus>
+std::uint16_t m6502Core<Bus>::popShort()
 {
+	if (regSP < 0xFE) {
+		std::uint16_t val = stackPage != nullptr ? stackPage[regSP + 1] | (stackPage[regSP + 2] << 8) :
+			addressBus.readWord(regSP + 0x101);
+		regSP += 2;
+		return val;
+	}
+	// The stack pointer wraps round within page one.
 	std::uint16_t loByte = popByte();
 	std::uint8_t hiByte = popByte();
 	return (hiByte << 8) | loByte;
 }
 
-void m6502::doAND(std::uint8_t val)
+template <class Bus>
+void m6502Core<Bus>::doAND(std::uint8_t val)
 {
 	regA &= val;
-	zFlag = regA == 0;
-	nFlag = regA >= 0x80;
+	setNZFlags(regA);
 }
 
-void m6502::doORA(std::uint8_t val)
+template <class Bus>
+void m6502Core<Bus>::doORA(std::uint8_t val)
 {
 	regA |= val;
-	zFlag = regA == 0;
-	nFlag = regA >= 0x80;
+	setNZFlags(regA);
 }
 
-void m6502::doEOR(std::uint8_t val)
+template <class Bus>
+void m6502Core<Bus>::doEOR(std::uint8_t val)
 {
 	regA ^= val;
-	zFlag = regA == 0;
-	nFlag = regA >= 0x80;
+	setNZFlags(regA);
 }
 
-void m6502::doCMP(std::uint8_t val)
+template <class Bus>
+void m6502Core<Bus>::doCMP(std::uint8_t val)
 {
-	cFlag = (regA >= val);
-	zFlag = (regA == val);
-	nFlag = (((regA - val) & 0x80) == 0x80);
+	setCarry(regA >= val);
+	setNZFlags(regA - val);
 }
 
-void m6502::doCPX(std::uint8_t val)
+template <class Bus>
+void m6502Core<Bus>::doCPX(std::uint8_t val)
 {
-	cFlag = (regX >= val);
-	zFlag = (regX == val);
-	nFlag = (((regX - val) & 0x80) == 0x80);
+	setCarry(regX >= val);
+	setNZFlags(regX - val);
 }
 
-void m6502::doCPY(std::uint8_t val)
+template <class Bus>
+void m6502Core<Bus>::doCPY(std::uint8_t val)
 {
-	cFlag = (regY >= val);
-	zFlag = (regY == val);
-	nFlag = (((regY - val) & 0x80) == 0x80);
+	setCarry(regY >= val);
+	setNZFlags(regY - val);
 }
 
-void m6502::doADC(std::uint8_t val)
+template <class Bus>
+void m6502Core<Bus>::doADC(std::uint8_t val)
 {
-	std::uint8_t originalRegA = regA;
-	std::uint16_t result = regA + val + cFlag;
-	if (decimalMode) {
-		if ((result & 0x0f) > 9) {
-			// if A, result += 0x10, result -= 0x0A => result += 6
-			result += 6;
-		}
-		if ((result & 0xf0) > 0x90) {
-			result += 0x60;
-		}
+	if (decimalMode()) {
+		setDecimalResult(decimalTables.adc[carry()][regA][val]);
+	}
+	else {
+		doBinaryADC(val);
+	}
+}
+
+template <class Bus>
+void m6502Core<Bus>::doSBC(std::uint8_t val)
+{
+	if (decimalMode()) {
+		setDecimalResult(decimalTables.sbc[carry()][regA][val]);
+	}
+	else {
+		doBinaryADC(~val);
 	}
+}
 
-	cFlag = result > 0xFF;
+template <class Bus>
+void m6502Core<Bus>::setDecimalResult(std::uint16_t entry)
+{
+	regA = entry & 0xFF;
+	setP((getP() & 0x3C) | (entry >> 8));
+}
+
+template <class Bus>
+void m6502Core<Bus>::doBinaryADC(std::uint8_t val)
+{
+	std::uint8_t originalRegA = regA;
+	std::uint16_t result = regA + val + carry();
+
+	setCarry(result > 0xFF);
 	regA = result & 0xFF;
 	bool val1Negative = val > 0x7f;
 	bool val2Negative = originalRegA > 0x7F;
 	bool resultNegative = regA > 0x7F;
 	if (val1Negative && val2Negative && !resultNegative) {
 		// adding 2 negatives should not give a positive
-		vFlag = true;
+		setOverflow(true);
 	}
 	else if (!val1Negative && !val2Negative && resultNegative) {
 		// adding 2 positives should not give a negative
-		vFlag = true;
+		setOverflow(true);
 	}
 	else {
-		vFlag = false;
+		setOverflow(false);
 	}
-	
-	zFlag = regA == 0;	
+
+	setNZFlags(regA);
+}
+
+template <class Bus>
+void m6502Core<Bus>::doBIT(std::uint8_t val)
+{
+	setZResult(val & regA);
+	setNResult(val);
+	setOverflow((val & 0x40) == 0x40);
 }
 
-std::uint8_t m6502::doASL(std::uint8_t val)
+template <class Bus>
+std::uint8_t m6502Core<Bus>::doASL(std::uint8_t val)
 {
 	std::uint8_t outval = val << 1;
-	zFlag = outval == 0;
-	nFlag = outval >= 0x80;
-	cFlag = val >= 0x80;
+	setNZFlags(outval);
+	setCarry(val >= 0x80);
 	return outval;
 }
 
-std::uint8_t m6502::doLSR(std::uint8_t val)
+template <class Bus>
+std::uint8_t m6502Core<Bus>::doLSR(std::uint8_t val)
 {
 	std::uint8_t outval = val >> 1;
-	zFlag = outval == 0;
-	nFlag = false;
-	cFlag = (val & 0x01) == 0x01;
+	setNZFlags(outval);
+	setCarry((val & 0x01) == 0x01);
 	return outval;
 }
 
-std::uint8_t m6502::doROL(std::uint8_t val)
+template <class Bus>
+std::uint8_t m6502Core<Bus>::doROL(std::uint8_t val)
 {
 	std::uint8_t outval = val << 1;
-	if (cFlag) {
+	if (carry()) {
 		outval |= 0x01;
 	}
-	zFlag = outval == 0;
-	nFlag = outval >= 0x80;
-	cFlag = val >= 0x80;
+	setNZFlags(outval);
+	setCarry(val >= 0x80);
 	return outval;
 }
 
-std::uint8_t m6502::doROR(std::uint8_t val)
+template <class Bus>
+std::uint8_t m6502Core<Bus>::doROR(std::uint8_t val)
 {
 	std::uint8_t outval = val >> 1;
-	if (cFlag) {
+	if (carry()) {
 		outval |= 0x80;
 	}
-	zFlag = outval == 0;
-	nFlag = outval >= 0x80;
-	cFlag = (val & 0x01) == 0x01;
+	setNZFlags(outval);
+	setCarry((val & 0x01) == 0x01);
 	return outval;
 }
 
-void m6502::doBranch(bool predicate, std::int8_t offset)
+template <class Bus>
+void m6502Core<Bus>::doBranch(bool predicate, std::int8_t offset)
 {
-	regPC += 2;
-	cycleCount += 2;
 	if (predicate) {
 		int targetAddr = regPC + offset;
 		if ((targetAddr & 0xFF00) != (regPC & 0xFF00)) {
@@ -698,7 +1097,8 @@ void m6502::doBranch(bool predicate, std::int8_t offset)
 	}
 }
 
-void m6502::doPhp()
+template <class Bus>
+void m6502Core<Bus>::doPhp()
 {
 	/*
 	The flags are copied to memory in this arrangement:
@@ -712,696 +1112,380 @@ void m6502::doPhp()
 	Bit 1 : Zero
 	Bit 0 : Carry
 	*/
-	std::uint8_t flags = 0x30;
-	if (nFlag) { flags |= 0x80; }
-	if (vFlag) { flags |= 0x40; }
-	if (decimalMode) { flags |= 0x08; }
-	if (interruptDisable) { flags |= 0x04; }
-	if (zFlag) { flags |= 0x02; }
-	if (cFlag) { flags |= 0x01; }
+	pushByte(getP());
+}
+
+template <class Bus>
+void m6502Core<Bus>::doPlp()
+{
+	setP(popByte());
+}
+
+template <class Bus>
+void m6502Core<Bus>::opPhp(m6502Core& cpu, std::uint16_t)
+{
+	cpu.doPhp();
+}
+
+template <class Bus>
+void m6502Core<Bus>::opPlp(m6502Core& cpu, std::uint16_t)
+{
+	cpu.doPlp();
+	cpu.checkIrqAfterNext();
+}
+
+template <class Bus>
+void m6502Core<Bus>::opCli(m6502Core& cpu, std::uint16_t)
+{
+	cpu.setInterruptDisable(false);
+	cpu.checkIrqAfterNext();
+}
+
+template <class Bus>
+void m6502Core<Bus>::opPha(m6502Core& cpu, std::uint16_t)
+{
+	cpu.pushByte(cpu.regA);
+}
+
+template <class Bus>
+void m6502Core<Bus>::opPla(m6502Core& cpu, std::uint16_t)
+{
+	cpu.regA = cpu.popByte();
+	cpu.setNZFlags(cpu.regA);
+}
+
+template <class Bus>
+void m6502Core<Bus>::opTxs(m6502Core& cpu, std::uint16_t)
+{
+	// Unlike the other transfers, TXS does not touch the flags.
+	cpu.regSP = cpu.regX;
+}
 
-	pushByte(flags);
+template <class Bus>
+void m6502Core<Bus>::opJsr(m6502Core& cpu, std::uint16_t operand)
+{
+	// The return address pushed is the last byte of the JSR instruction.
+	cpu.pushShort(cpu.regPC - 1);
+	cpu.regPC = operand;
+}
+
+template <class Bus>
+void m6502Core<Bus>::opJmp(m6502Core& cpu, std::uint16_t operand)
+{
+	cpu.regPC = operand;
+}
+
+template <class Bus>
+void m6502Core<Bus>::opRts(m6502Core& cpu, std::uint16_t)
+{
+	cpu.regPC = cpu.popShort() + 1;
+}
+
+template <class Bus>
+void m6502Core<Bus>::opRti(m6502Core& cpu, std::uint16_t)
+{
+	cpu.doPlp();
+	cpu.regPC = cpu.popShort();
+	cpu.checkIrq();
+}
+
+template <class Bus>
+void m6502Core<Bus>::opNop(m6502Core&, std::uint16_t)
+{
 }
 
-void m6502::doPlp()
+template <class Bus>
+void m6502Core<Bus>::opUnknown(m6502Core& cpu, std::uint16_t)
 {
-	std::uint8_t flags = popByte();
-	nFlag = (flags & 0x80) == 0x80;
-	vFlag = (flags & 0x40) == 0x40;
-	decimalMode = (flags & 0x08) == 0x08;
-	interruptDisable = (flags & 0x04) == 0x04;
-	zFlag = (flags & 0x02) == 0x02;
-	cFlag = (flags & 0x01) == 0x01;
+	std::cerr << "unknown opcode: 0x" << std::setw(2) << std::setfill('0') << std::hex << (int)cpu.addressBus.readByte(cpu.regPC) << " , ";
+	std::cerr << "PC = 0x" << std::setw(4) << std::setfill('0') << std::hex << cpu.regPC;
 }
 
-void m6502::step()
+template <class Bus>
+void m6502Core<Bus>::checkIrq()
 {
-	int cycles = 0;
-	if (!interruptDisable && !irqLine) {
-		pushShort(regPC);
-		doPhp();
-		interruptDisable = true;
-		regPC = addressBus.readByte(0xFFFF) * 256 + addressBus.readByte(0xFFFE);
-		cycles += 7;
+	if (!interruptDisable() && !irqLine) {
+		enterInterrupt(0xFFFE);
 	}
-	int opcode = addressBus.readByte(regPC);
-	switch (opcode)
-	{
-		case 0x01:
-			// ORA ($nn,X)
-			{
-				doORA(readIndexedIndirect());
-				regPC += 2;
-				cycleCount += 6;
-			}
-			break;
-		case 0x05:
-			// ORA $nn
-			{
-				doORA(readZeroPageValue());
-				regPC += 2;
-				cycleCount += 3;
-			}
-			break;
-		case 0x06:
-			{
-				// ASL $nn
-				std::uint8_t zPageAddr = addressBus.readByte(regPC + 1);
-				std::uint8_t newVal = doASL(addressBus.readByte(zPageAddr));
-				addressBus.writeByte(zPageAddr, newVal);
-				regPC += 2;
-				cycleCount += 5;
-			}
-			break;
-		case 0x09:
-			// ORA #nn
-			{
-				doORA(addressBus.readByte(regPC + 1));
-				regPC += 2;
-				cycleCount += 2;
-			}
-			break;
-		case 0x08:
-			// PHP
-			{
-				doPhp();
-				regPC += 1;
-				cycleCount += 3;
-			}
-			break;
-		case 0x0A:
-			{
-				// ASL A
-				regA = doASL(regA);
-				regPC += 1;
-				cycleCount += 2;
-			}
-			break;
-		case 0x0e:
-			{
-				// ASL $nnnn
-				std::uint16_t addr = addressBus.readByte(regPC + 1) + (addressBus.readByte(regPC + 2) << 8);
-				std::uint8_t newVal = doASL(addressBus.readByte(addr));
-				addressBus.writeByte(addr, newVal);
-				regPC += 3;
-				cycleCount += 6;
-			}
-			break;
-		case 0x10:
-			// BPL $nn
-			{
-				doBranch(!nFlag, addressBus.readByte(regPC + 1));
-			}
-			break;
-		case 0x18:
-			{
-				// CLC
-				cFlag = false;
-				regPC += 1;
-				cycleCount += 2;
-			}
-			break;
-		case 0x20:
-			{
-				// JSR
-				std::uint16_t retAddr = regPC + 2;
-				std::uint16_t targetAddr = (addressBus.readByte(regPC + 2) << 8) | addressBus.readByte(regPC + 1);
-				pushShort(retAddr);
-				regPC = targetAddr;
-				cycleCount += 6;
-			}
-			break;
-		case 0x21:
-			{
-				// AND ($nn,X)
-				doAND(readIndexedIndirect());
-				regPC += 2;
-				cycleCount += 6;
-			}
-			break;
-		case 0x24:
-			{
-				// BIT $nn
-				std::uint8_t bitVal = readZeroPageValue();
-				zFlag = (bitVal & regA) == 0;
-				nFlag = (bitVal & 0x80) == 0x80;
-				vFlag = (bitVal & 0x40) == 0x40;
-				regPC += 2;
-				cycleCount += 3;
-			}
-			break;
-		case 0x25:
-			{
-				doAND(readZeroPageValue());
-				regPC += 2;
-				cycleCount += 3;
-			}
-			break;
-		case 0x26:
-			{
-				// ROL $nn
-				std::uint8_t zPageAddr = addressBus.readByte(regPC + 1);
-				std::uint8_t newVal = doROL(addressBus.readByte(zPageAddr));
-				addressBus.writeByte(zPageAddr, newVal);
-				regPC += 2;
-				cycleCount += 5;
-			}
-			break;
-		case 0x28:
-			{
-				// PLP
-				doPlp();
+}
 
-				regPC += 1;
-				cycleCount += 4;
-			}
-			break;
-		case 0x29:
-			// AND #nn
-			{
-				doAND(addressBus.readByte(regPC + 1));
-				regPC += 2;
-				cycleCount += 2;
-			}
-			break;
-		case 0x30:
-			// BMI $nn
-			{
-				doBranch(nFlag, addressBus.readByte(regPC + 1));
-			}
-			break;
-		case 0x38:
-			{
-				// SEC
-				cFlag = true;
-				regPC += 1;
-				cycleCount += 2;
-			}
-			break;
-		case 0x40:
-			// RTI
-			{
-				doPlp();
-				regPC = popShort();
-				cycleCount += 6;
-			}
-			break;
-		case 0x41:
-			// EOR ($nn,X)
-			{
-				doEOR(readIndexedIndirect());
-				regPC += 2;
-				cycleCount += 6;
-			}
-			break;
-		case 0x45:
-			// EOR $nn
-			{
-				doEOR(readZeroPageValue());
-				regPC += 2;
-				cycleCount += 3;
-			}
-			break;
-		case 0x46:
-			{
-				// LSR $nn
-				std::uint8_t zPageAddr = addressBus.readByte(regPC + 1);
-				std::uint8_t newVal = doLSR(addressBus.readByte(zPageAddr));
-				addressBus.writeByte(zPageAddr, newVal);
-				regPC += 2;
-				cycleCount += 5;
-			}
-			break;
-		case 0x48:
-			{
-				// PHA
-				pushByte(regA);
-				regPC += 1;
-				cycleCount += 3;
-			}
-			break;
-		case 0x49:
-			// EOR #nn
-			{
-				doEOR(addressBus.readByte(regPC + 1));
-				regPC += 2;
-				cycleCount += 2;
-			}
-			break;
-		case 0x4A:
-			{
-				// LSR A
-				regA = doLSR(regA);
-				regPC += 1;
-				cycleCount += 2;
-			}
-			break;
-		case 0x4c:
-			{
-				// JMP nnnn
-				std::uint16_t targetAddr = (addressBus.readByte(regPC + 2) << 8) | addressBus.readByte(regPC + 1);
-				regPC = targetAddr;
-				cycleCount += 3;
-			}
-			break;
-		case 0x50:
-			// BVC $nn
-			{
-				doBranch(!vFlag, addressBus.readByte(regPC + 1));
-			}
-			break;
-		case 0x58:
-			// CLI
-			{
-				interruptDisable = false;
-				cycleCount += 2;
-				regPC += 1;
-			}
-			break;
-		case 0x5d:
-			{
-				// EOR nn, X
-				std::uint8_t val = readAbsoluteX();
-				doEOR(val);
-				cycleCount += 4;
-				regPC += 3;
-			}
-			break;
-		case 0x60:
-			{
-				// RTS
-				regPC = popShort() + 1;
-				cycleCount += 6;
-			}
-			break;
-		case 0x65:
-			// ADC $nn
-			{
-				doADC(readZeroPageValue());
-				regPC += 2;
-				cycleCount += 3;
-			}
-			break;
-		case 0x68:
-			{
-				// PLA
-				regA = popByte();
-				zFlag = regA == 0;
-				nFlag = regA > 0x7F;
-				regPC += 1;
-				cycleCount += 4;
-			}
-			break;
-		case 0x69:
-			{
-				doADC(addressBus.readByte(regPC + 1));
-				regPC += 2;
-				cycleCount += 2;
-			}
-			break;
-		case 0x6A:
-			{
-				regA = doROR(regA);
-				regPC += 1;
-				cycleCount += 2;
-			}
-			break;
-		case 0x78:
-			// SEI
-			{
-				interruptDisable = true;
-				regPC += 1;
-				cycleCount += 2;
-			}
-			break;
-		case 0x7d:
-			{
-				doADC(readAbsoluteX());
-				regPC += 3;
-				cycleCount += 4;
-			}
-			break;
-		case 0x81:
-			{
-				writeIndexedIndirect(regA);
-				regPC += 2;
-				cycleCount += 6;
-			}
-			break;
-		case 0x84:
-			{
-				writeZeroPageValue(regY);
-				regPC += 2;
-				cycleCount += 3;
-			}
-			break;
-		case 0x85:
-			{
-				writeZeroPageValue(regA);
-				regPC += 2;
-				cycleCount += 3;
-			}
-			break;
-		case 0x86:
-			{
-				writeZeroPageValue(regX);
-				regPC += 2;
-				cycleCount += 3;
-			}
-			break;
-		case 0x88:
-			{
-				regY -= 1;
-				setNZFlags(regY);
-				regPC += 1;
-				cycleCount += 2;
-			}
-			break;
-		case 0x8a:
-			{
-				regA = regX;
-				setNZFlags(regX);
-				regPC += 1;
-				cycleCount += 2;
-			}
-			break;
-		case 0x8d:
-			{
-				writeAbsolute(regA);
-				regPC += 3;
-				cycleCount += 4;
-			}
-			break;
-		case 0x90:
-			{
-				doBranch(!cFlag, addressBus.readByte(regPC + 1));
-			}
-			break;
-		case 0x91:
-			{
-				writeIndirectIndexedY(regA);
-				regPC += 2;
-				cycleCount += 6;
-			}
-			break;
-		case 0x95:
-			{
-				writeZeroPageXValue(regA);
-				regPC += 2;
-				cycleCount += 4;
-			}
-			break;
-		case 0x98:
-			{
-				regA = regY;
-				setNZFlags(regA);
-				regPC += 1;
-				cycleCount += 2;
-			}
-			break;
-		case 0x99:
-			{
-				writeAbsoluteY(regA);
-				regPC += 3;
-				cycleCount += 5;
-			}
-			break;
-		case 0x9A:
-			{
-				regSP = regX;
-				regPC += 1;
-				cycleCount += 2;
-			}
-			break;
-		case 0xa0:
-			{
-				regY = addressBus.readByte(regPC + 1);
-				setNZFlags(regY);
-				regPC += 2;
-				cycleCount += 2;
-			}
-			break;
-		case 0xA2:
-			{
-				regX = addressBus.readByte(regPC + 1);
-				setNZFlags(regX);
-				regPC += 2;
-				cycleCount += 2;
-			}
-			break;
-		case 0xa4:
-			{
-				regY = readZeroPageValue();
-				setNZFlags(regY);
-				regPC += 2;
-				cycleCount += 3;
-			}
-			break;
-		case 0xa5:
-			{
-				regA = readZeroPageValue();
-				setNZFlags(regA);
-				regPC += 2;
-				cycleCount += 3;
-			}
-			break;
-		case 0xa6:
-			{
-				regX = readZeroPageValue();
-				setNZFlags(regX);
-				regPC += 2;
-				cycleCount += 3;
-			}
-			break;
-		case 0xa8:
-			{
-				regY = regA;
-				setNZFlags(regY);
-				regPC += 1;
-				cycleCount += 2;
-			}
-			break;
-		case 0xA9:
-			{
-				regA = addressBus.readByte(regPC + 1);
-				setNZFlags(regA);
-				regPC += 2;
-				cycleCount += 2;
-			}
-			break;
-		case 0xAA:
-			{
-				regX = regA;
-				setNZFlags(regX);
-				regPC += 1;
-				cycleCount += 2;
-			}
-			break;
-		case 0xad:
-			{
-				regA = readAbsolute();
-				setNZFlags(regA);
-				regPC += 3;
-				cycleCount += 4;
-			}
-			break;
-		case 0xb0:
-			{
-				doBranch(cFlag, addressBus.readByte(regPC + 1));
-			}
-			break;
-		case 0xb1:
-			{
-				regA = readIndirectIndexedY();
-				setNZFlags(regA);
-				regPC += 2;
-				cycleCount += 5;
-			}
-			break;
-		case 0xb4:
-			{
-				regY = readZeroPageXValue();
-				setNZFlags(regY);
-				regPC += 2;
-				cycleCount += 4;
-			}
-			break;
-		case 0xb5:
-			{
-				regA = readZeroPageXValue();
-				setNZFlags(regA);
-				regPC += 2;
-				cycleCount += 4;
-			}
-			break;
-		case 0xb9:
-			{
-				regA = readAbsoluteY();
-				setNZFlags(regA);
-				regPC += 3;
-				cycleCount += 4;
-			}
-			break;
-		case 0xbd:
-			{
-				regA = readAbsoluteX();
-				setNZFlags(regA);
-				regPC += 3;
-				cycleCount += 4;
-			}
-			break;
-		case 0xbc:
-			{
-				regY = readAbsoluteX();
-				setNZFlags(regY);
-				regPC += 3;
-				cycleCount += 4;
-			}
-			break;
-		case 0xc5:
-			{
-				doCMP(readZeroPageValue());
-				regPC += 2;
-				cycleCount += 3;
-			}
-			break;
-		case 0xc6:
-			{
-				std::uint8_t val = readZeroPageValue();
-				--val;
-				writeZeroPageValue(val);
-				setNZFlags(val);
-				regPC += 2;
-				cycleCount += 5;
-			}
-			break;
-		case 0xc8:
-			{
-				regY += 1;
-				zFlag = regY == 0;
-				nFlag = regY >= 0x80;
-				regPC += 1;
-				cycleCount += 2;
-			}
-			break;
-		case 0xc9:
-			{
-				doCMP(addressBus.readByte(regPC + 1));
-				regPC += 2;
-				cycleCount += 2;
-			}
-			break;
-		case 0xca:
-			{
-				regX -= 1;
-				zFlag = regX == 0;
-				nFlag = regX >= 0x80;
-				regPC += 1;
-				cycleCount += 2;
-			}
-			break;
-		case 0xcc:
-			{
-				doCPY(readAbsolute());
-				regPC += 3;
-				cycleCount += 4;
-			}
-			break;
-		case 0xd0:
-			{
-				doBranch(!zFlag, addressBus.readByte(regPC + 1));
-			}
-			break;
-		case 0xd8:
-			{
-				decimalMode = false;
-				regPC += 1;
-				cycleCount += 2;
-			}
-			break;
-		case 0xd9:
-			{
-				doCMP(readAbsoluteY());
-				regPC += 3;
-				cycleCount += 4;
-			}
-			break;
-		case 0xdd:
-			{
-				doCMP(readAbsoluteX());
-				regPC += 3;
-				cycleCount += 4;
-			}
-			break;
-		case 0xe0:
-			{
-				doCPX(addressBus.readByte(regPC + 1));
-				regPC += 2;
-				cycleCount += 2;
-			}
-			break;
-		case 0xe5:
-			{
-				doADC(~readZeroPageValue());
-				regPC += 2;
-				cycleCount += 3;
-			}
-			break;
-		case 0xe6:
-			{
-				std::uint8_t val = readZeroPageValue();
-				++val;
-				writeZeroPageValue(val);
-				setNZFlags(val);
-				regPC += 2;
-				cycleCount += 5;
-			}
-			break;
-		case 0xe8:
-			{
-				regX += 1;
-				zFlag = regX == 0;
-				nFlag = regX >= 0x80;
-				regPC += 1;
-				cycleCount += 2;
-			}
-			break;
-		case 0xe9:
-			{
-				doADC(~addressBus.readByte(regPC + 1));
-				regPC += 2;
-				cycleCount += 2;
-			}
-			break;
-		case 0xea:
-			{
-				// NOP
-				regPC += 1;
-				cycleCount += 2;
-			}
-			break;
-		case 0xed:
-			{
-				doADC(~readAbsolute());
-				regPC += 3;
-				cycleCount += 4;
-			}
-			break;
-		case 0xf0:
-			{
-				doBranch(zFlag, addressBus.readByte(regPC + 1));
-			}
-			break;
-		case 0xf8:
-			{
-				decimalMode = true;
-				regPC += 1;
-				cycleCount += 2;
-			}
-			break;
-		default:
-			std::cerr << "unknown opcode: 0x" << std::setw(2) << std::setfill('0') << std::hex << opcode << " , ";
-			std::cerr << "PC = 0x" << std::setw(4) << std::setfill('0') << std::hex << regPC;
-			break;
+template <class Bus>
+void m6502Core<Bus>::checkIrqAfterNext()
+{
+	if (!interruptDisable() && !irqLine) {
+		pendingWork |= PENDING_IRQ_NEXT;
+	}
+}
+
+template <class Bus>
+void m6502Core<Bus>::enterInterrupt(std::uint16_t vector)
+{
+	pushShort(regPC);
+	doPhp();
+	setInterruptDisable(true);
+	regPC = addressBus.readWord(vector);
+	cycleCount += 7;
+}
+
+template <class Bus>
+void m6502Core<Bus>::takeInterrupts()
+{
+	if ((pendingWork & PENDING_RESET) != 0) {
+		pendingWork &= ~(PENDING_RESET | PENDING_NMI | PENDING_IRQ_NEXT);
+		regPC = addressBus.readWord(0xFFFC);
+		setInterruptDisable(true);
+		cycleCount += 7;
+	}
+	else if ((pendingWork & PENDING_NMI) != 0) {
+		pendingWork &= ~PENDING_NMI;
+		enterInterrupt(0xFFFA);
+	}
+	// An irq that can't be taken now is checked again when CLI, PLP or RTI enable them,
+	// and one CLI or PLP has just let in waits for the instruction after them.
+	pendingWork &= ~PENDING_IRQ;
+	if ((pendingWork & PENDING_IRQ_NEXT) == 0) {
+		checkIrq();
+	}
+}
+
+template <class Bus>
+bool m6502Core<Bus>::doPendingWork(std::int64_t cycleTarget)
+{
+	if ((pendingWork & (PENDING_RESET | PENDING_NMI | PENDING_IRQ)) != 0) {
+		takeInterrupts();
+		if (cycleCount >= cycleTarget) {
+			return false;
+		}
+	}
+	// The instruction after CLI or PLP runs before the irq they let in.
+	if ((pendingWork & PENDING_IRQ_NEXT) != 0) {
+		pendingWork = (pendingWork & ~PENDING_IRQ_NEXT) | PENDING_IRQ;
+	}
+	if ((pendingWork & PENDING_BREAKPOINT) != 0) {
+		if (regPC != breakpointResumePC && breakpoints.count(regPC) != 0) {
+			breakpointResumePC = regPC;
+			return false;
+		}
+		breakpointResumePC = -1;
+	}
+	if ((pendingWork & PENDING_TRACE) != 0) {
+		traceHandler(*this);
+	}
+	return true;
+}
+
+template <class Bus>
+void m6502Core<Bus>::addBreakpoint(std::uint16_t pc)
+{
+	breakpoints.insert(pc);
+	pendingWork |= PENDING_BREAKPOINT;
+}
+
+template <class Bus>
+void m6502Core<Bus>::removeBreakpoint(std::uint16_t pc)
+{
+	breakpoints.erase(pc);
+	if (breakpoints.empty()) {
+		pendingWork &= ~PENDING_BREAKPOINT;
+		breakpointResumePC = -1;
 	}
 }
+
+template <class Bus>
+void m6502Core<Bus>::setTraceHandler(TraceHandler handler)
+{
+	traceHandler = std::move(handler);
+	if (traceHandler) {
+		pendingWork |= PENDING_TRACE;
+	}
+	else {
+		pendingWork &= ~PENDING_TRACE;
+	}
+}
+
+#if defined(M6502_THREADED)
+
+template <class Bus>
+void m6502Core<Bus>::step()
+{
+	// An interrupt is entered first so that its handler's first instruction runs in this step.
+	if ((pendingWork & (PENDING_RESET | PENDING_NMI | PENDING_IRQ)) != 0) {
+		takeInterrupts();
+	}
+	// Every opcode takes at least one cycle so this runs exactly one instruction.
+	execute(cycleCount + 1);
+}
+
+/*
+Threaded-code engine. Each opcode has its own label and ends by fetching the next
+opcode and jumping straight to its label, so the branch predictor sees one indirect
+branch per opcode rather than a single shared one. Uses the GCC/Clang labels-as-values
+extension.
+*/
+template <class Bus>
+void m6502Core<Bus>::execute(std::int64_t cycleTarget)
+{
+	static void* const labels[256] = {
+#define M6502_OPCODE(opcode, length, cycles, handler) &&op_##opcode,
+#include "m6502_opcodes.h"
+#undef M6502_OPCODE
+	};
+
+	const DecodedInstruction* insn;
+
+#define M6502_DISPATCH()						\
+	if (cycleCount >= cycleTarget) {			\
+		return;									\
+	}											\
+	if (pendingWork != 0 &&						\
+		!doPendingWork(cycleTarget)) {			\
+		return;									\
+	}											\
+	insn = &fetch();							\
+	goto *labels[insn->opcode]
+
+	M6502_DISPATCH();
+
+	// Unknown opcodes do not move the PC so stop rather than spin on them.
+#define M6502_OPCODE(opcode, length, cycles, handler)	\
+	op_##opcode:										\
+		regPC += length;								\
+		cycleCount += cycles;							\
+		handler(*this, insn->operand);					\
+		if (length == 0) {								\
+			return;										\
+		}												\
+		M6502_DISPATCH();
+#include "m6502_opcodes.h"
+#undef M6502_OPCODE
+#undef M6502_DISPATCH
+}
+
+#elif defined(M6502_JIT)
+
+template <class Bus>
+m6502Core<Bus>::m6502Core(Bus& ab) : addressBus(ab), jit(new m6502Jit<Bus>(*this))
+{
+}
+
+template <class Bus>
+m6502Core<Bus>::~m6502Core()
+{
+}
+
+template <class Bus>
+void m6502Core<Bus>::step()
+{
+	if (pendingWork != 0 && !doPendingWork(std::numeric_limits<std::int64_t>::max())) {
+		return;
+	}
+	if (!jit->runInstruction()) {
+		const DecodedInstruction& insn = fetch();
+		const OpHandler handler = insn.handler;
+		regPC += insn.length;
+		cycleCount += insn.cycles;
+		handler(*this, insn.operand);
+	}
+}
+
+/*
+Compiled blocks are used when the whole block fits in what is left of the budget,
+otherwise instructions go through the interpreter one at a time. CLI, PLP and RTI are
+never compiled, so an irq they let in is always taken by the interpreter.
+*/
+template <class Bus>
+void m6502Core<Bus>::execute(std::int64_t cycleTarget)
+{
+	while (cycleCount < cycleTarget) {
+		if (pendingWork != 0 && !doPendingWork(cycleTarget)) {
+			return;
+		}
+		// Breakpoints and tracing need every instruction boundary, so blocks only run without them.
+		if (pendingWork == 0 && jit->runBlock(static_cast<int>(cycleTarget - cycleCount))) {
+			continue;
+		}
+		// The handler may invalidate the block insn lives in, so nothing is read from it afterwards.
+		const DecodedInstruction& insn = fetch();
+		const OpHandler handler = insn.handler;
+		const std::uint8_t length = insn.length;
+		regPC += length;
+		cycleCount += insn.cycles;
+		handler(*this, insn.operand);
+		if (length == 0) {
+			return;
+		}
+	}
+}
+
+#else
+
+template <class Bus>
+void m6502Core<Bus>::step()
+{
+	if (pendingWork != 0 && !doPendingWork(std::numeric_limits<std::int64_t>::max())) {
+		return;
+	}
+	const DecodedInstruction& insn = fetch();
+	const OpHandler handler = insn.handler;
+	regPC += insn.length;
+	cycleCount += insn.cycles;
+	handler(*this, insn.operand);
+}
+
+template <class Bus>
+void m6502Core<Bus>::execute(std::int64_t cycleTarget)
+{
+	while (cycleCount < cycleTarget) {
+		if (pendingWork != 0 && !doPendingWork(cycleTarget)) {
+			return;
+		}
+		// A store can invalidate the block insn lives in, so it is not read after the handler.
+		const DecodedInstruction& insn = fetch();
+		const OpHandler handler = insn.handler;
+		const std::uint8_t length = insn.length;
+		regPC += length;
+		cycleCount += insn.cycles;
+		handler(*this, insn.operand);
+		if (length == 0) {
+			return;
+		}
+	}
+}
+
+#endif
+
+template <class Bus>
+int m6502Core<Bus>::run(int cycles)
+{
+	std::int64_t cycleTarget = cycleCount + cycles;
+	// Memory, or the bus's memory map, may have changed since the last run.
+	idleLoopPC = -1;
+	mapFastPages();
+	// The line may have been left low while interrupts were disabled from outside.
+	if (!irqLine) {
+		pendingWork |= PENDING_IRQ;
+	}
+	idleSkipTarget = cycleTarget;
+	execute(cycleTarget);
+	idleSkipTarget = 0;
+	return static_cast<int>(cycleCount - cycleTarget);
+}
+
+template <class Bus>
+bool m6502Core<Bus>::runUntil(Scheduler& scheduler, std::int64_t endTime)
+{
+	for (;;) {
+		scheduler.runEvents(cycleCount);
+		if (cycleCount >= endTime) {
+			return true;
+		}
+		std::int64_t sliceEnd = std::min(endTime, scheduler.nextEventTime());
+		int cycles = static_cast<int>(std::min<std::int64_t>(sliceEnd - cycleCount, std::numeric_limits<int>::max()));
+		if (run(cycles) < 0) {
+			return false;
+		}
+	}
+}
+
+template class m6502Core<AddressBus>;
+template class m6502Core<DirectAddressBus>;
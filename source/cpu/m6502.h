@@ -1,16 +1,164 @@
 #pragma once
 
 #include<string>
+#include <cstdint>
+#include <type_traits>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 #include "../address_bus.h"
 #include "../debug_info.h"
+#include "../scheduler.h"
 
-class m6502
+template <class Bus>
+class m6502Jit;
+
+/*
+The architectural state of a 6502. It is kept small and sits at the very start of the cpu
+object so the fields every instruction touches share a cache line, and it is trivially
+copyable so a snapshot is just a copy of this base.
+
+The C, Z, I, D, V and N flags are bits of the P register, read and set through the
+accessors below, so there is nothing to pack or unpack for PHP, PLP or interrupts.
+*/
+class m6502State
 {
 public:
-	m6502(AddressBus& ab) : addressBus(ab) {}
+	static const std::uint8_t FLAG_CARRY = 0x01;
+	static const std::uint8_t FLAG_ZERO = 0x02;
+	static const std::uint8_t FLAG_INTERRUPT_DISABLE = 0x04;
+	static const std::uint8_t FLAG_DECIMAL = 0x08;
+	static const std::uint8_t FLAG_OVERFLOW = 0x40;
+	static const std::uint8_t FLAG_NEGATIVE = 0x80;
+
+	// The P register with bits 4 and 5 always read as set, which is what PHP pushes.
+	std::uint8_t getP() const
+	{
+#if defined(M6502_LAZY_FLAGS)
+		return (regP & 0x4D) | 0x30 | (zResult == 0 ? FLAG_ZERO : 0) | (nResult & FLAG_NEGATIVE);
+#else
+		return regP | 0x30;
+#endif
+	}
+
+	void setP(std::uint8_t val)
+	{
+		regP = val;
+#if defined(M6502_LAZY_FLAGS)
+		setZero((val & FLAG_ZERO) != 0);
+		nResult = val;
+#endif
+	}
+
+	bool carry() const { return (regP & FLAG_CARRY) != 0; }
+	void setCarry(bool val) { setFlag(FLAG_CARRY, val); }
+	bool interruptDisable() const { return (regP & FLAG_INTERRUPT_DISABLE) != 0; }
+	void setInterruptDisable(bool val) { setFlag(FLAG_INTERRUPT_DISABLE, val); }
+	bool decimalMode() const { return (regP & FLAG_DECIMAL) != 0; }
+	void setDecimalMode(bool val) { setFlag(FLAG_DECIMAL, val); }
+	bool overflow() const { return (regP & FLAG_OVERFLOW) != 0; }
+	void setOverflow(bool val) { setFlag(FLAG_OVERFLOW, val); }
+
+#if defined(M6502_LAZY_FLAGS)
+	bool zero() const { return zResult == 0; }
+	void setZero(bool val) { zResult = val ? 0 : 1; }
+	bool negative() const { return (nResult & 0x80) != 0; }
+	void setNegative(bool val) { nResult = val ? 0x80 : 0; }
+#else
+	bool zero() const { return (regP & FLAG_ZERO) != 0; }
+	void setZero(bool val) { setFlag(FLAG_ZERO, val); }
+	bool negative() const { return (regP & FLAG_NEGATIVE) != 0; }
+	void setNegative(bool val) { setFlag(FLAG_NEGATIVE, val); }
+#endif
+
+	void setFlag(std::uint8_t mask, bool val)
+	{
+		regP = val ? (regP | mask) : (regP & ~mask);
+	}
+
+	std::int64_t cycleCount;
+	std::uint16_t	regPC;
+
+	std::uint8_t	regA;
+	std::uint8_t	regX;
+	std::uint8_t	regY;
+	std::uint8_t	regSP;
+
+	// Status flags. Under M6502_LAZY_FLAGS the Z and N bits are unused.
+	std::uint8_t	regP;
+#if defined(M6502_LAZY_FLAGS)
+	/*
+	Z and N keep the last result that set them and are only worked out when they are
+	read, which is usually a branch or PHP long after several more results have replaced it.
+	*/
+	std::uint8_t	zResult;
+	std::uint8_t	nResult;
+#endif
+
+	bool irqLine = true;
+
+	/*
+	Work for the next instruction boundary, one bit per kind. The engines test this one
+	word between instructions and only take the slow path when it is non-zero, however
+	many kinds of work there are.
+	*/
+	std::uint32_t pendingWork = 0;
+
+	static const std::uint32_t PENDING_IRQ = 0x01;
+	static const std::uint32_t PENDING_NMI = 0x02;
+	static const std::uint32_t PENDING_RESET = 0x04;
+	static const std::uint32_t PENDING_BREAKPOINT = 0x08;
+	static const std::uint32_t PENDING_TRACE = 0x10;
+	// CLI and PLP let an irq in after the instruction that follows them, not straight away.
+	static const std::uint32_t PENDING_IRQ_NEXT = 0x20;
+};
+
+static_assert(std::is_trivially_copyable<m6502State>::value, "m6502State must stay cheap to copy");
+
+/*
+The 6502 core, templated on the type of its address bus. With a concrete bus such as
+m6502Core<DirectAddressBus> the memory accesses are direct calls the compiler can inline;
+m6502 below works through the virtual AddressBus interface.
+*/
+template <class Bus>
+class m6502Core : public m6502State
+{
+public:
+#if defined(M6502_JIT)
+	m6502Core(Bus& ab);
+	~m6502Core();
+#else
+	m6502Core(Bus& ab) : addressBus(ab) {}
+#endif
 	void reset();
+	/**
+	 * Runs one instruction. A pending interrupt is entered first, and the instruction run
+	 * is then the first one of its handler.
+	*/
 	void step();
 
+	/**
+	 * Runs instructions until at least cycles have been used, or until an opcode the
+	 * cpu can't execute or a breakpoint is reached. Returns how far past the budget the last instruction
+	 * went, so a driver can take it off the next slice, or a negative number if it
+	 * stopped early.
+	 *
+	 * Polling loops in cached code that only read memory are fast-forwarded once a pass
+	 * round them leaves the cpu unchanged, so memory polled by such a loop must only be
+	 * changed between calls to run. Loops reading through a bus read handler are never
+	 * skipped.
+	*/
+	int run(int cycles);
+
+	/**
+	 * Runs until cycleCount reaches endTime, firing each event in scheduler at the first
+	 * instruction boundary at or after its time. Returns false if it stopped early on an
+	 * opcode the cpu can't execute or a breakpoint.
+	*/
+	bool runUntil(Scheduler& scheduler, std::int64_t endTime);
+
 	class OpcodeDesc
 	{
 	public:
@@ -21,58 +169,294 @@ public:
 
 	OpcodeDesc disassemble(unsigned short pc, DebugInfo& info);
 
-	std::uint8_t	regA;
-	std::uint8_t	regX;
-	std::uint8_t	regY;
+	/**
+	 * Pulling the irq line low takes the irq at the next instruction boundary if interrupts
+	 * are enabled, otherwise when CLI, PLP or RTI enables them. As on the real chip, CLI and
+	 * PLP only let it in after the instruction following them. Compiled code only stops
+	 * for it between blocks.
+	*/
+	void setIrqLow() { irqLine = false; pendingWork |= PENDING_IRQ; }
+	void setIrqHigh() { irqLine = true; }
 
-	std::uint8_t	regSP;
-	std::uint16_t	regPC;
+	/**
+	 * An edge on the nmi line; the nmi is taken at the next instruction boundary.
+	*/
+	void triggerNmi() { pendingWork |= PENDING_NMI; }
 
-	int cycleCount;
+	/**
+	 * Resets the cpu at the next instruction boundary. Unlike reset(), cycleCount carries on.
+	*/
+	void requestReset() { pendingWork |= PENDING_RESET; }
 
-	// Status flags
-	bool zFlag;
-	bool vFlag;
-	bool nFlag;
-	bool cFlag;
-	bool decimalMode;
-	bool interruptDisable;
+	/**
+	 * A run stops before the instruction at a breakpoint, and runs it when started again.
+	*/
+	void addBreakpoint(std::uint16_t pc);
+	void removeBreakpoint(std::uint16_t pc);
 
-	void setIrqLow() { irqLine = false; }
-	void setIrqHigh() { irqLine = true; }
+	// Called before every instruction, with regPC at the instruction, until cleared.
+	typedef std::function<void(const m6502State& state)> TraceHandler;
+	void setTraceHandler(TraceHandler handler);
+
+	/**
+	 * Allows decoded instructions between start and end to be cached. Meant for ROM, the range is
+	 * rounded out to whole pages. Writes made by this cpu invalidate any cached code in the page
+	 * written to; anything else that writes into the range must call invalidateCodeCache.
+	*/
+	void enableCodeCache(std::uint16_t start, std::uint16_t end);
+
+	/**
+	 * Drops any cached code in the page containing address. Safe to call from inside an
+	 * instruction, such as from a bus write handler: the dropped blocks are only freed
+	 * when the next instruction is fetched.
+	*/
+	void invalidateCodeCache(std::uint16_t address);
 
 private:
-	bool irqLine;
+	friend class m6502Jit<Bus>;
+
+	typedef void (*OpHandler)(m6502Core& cpu, std::uint16_t operand);
+
+	class OpcodeInfo
+	{
+	public:
+		OpHandler handler;
+		std::uint8_t length;
+		std::uint8_t cycles;
+	};
+
+	// Indexed by opcode, built from m6502_opcodes.h.
+	static const OpcodeInfo opcodeTable[256];
+
+	class DecodedInstruction
+	{
+	public:
+		OpHandler handler;
+		std::uint16_t pc;
+		std::uint16_t operand;
+		std::uint8_t opcode;
+		std::uint8_t length;
+		std::uint8_t cycles;
+		// Set on the first instruction of a block that is an idle loop, see decodeBlock.
+		std::uint8_t idleCycles;
+	};
+
+	const DecodedInstruction& fetch();
+	const DecodedInstruction& fetchBlock();
+	const std::vector<DecodedInstruction>& decodeBlock(std::uint16_t startPC);
+	void decode(std::uint16_t pc, DecodedInstruction& insn);
+	std::uint16_t fetchOperand(std::uint16_t pc, int length);
+	void writeByte(std::uint16_t address, std::uint8_t val);
+
+	// Used for instructions outside of the cached pages.
+	DecodedInstruction uncachedInstruction;
+
+	// The rest of the basic block being executed, if any.
+	const DecodedInstruction* nextDecoded = nullptr;
+	const DecodedInstruction* decodedBlockEnd = nullptr;
+
+	bool cacheablePages[256] = {};
+	bool cachedPages[256] = {};
+	std::vector<std::uint16_t> pageBlocks[256];
+	std::unordered_map<std::uint16_t, std::vector<DecodedInstruction>> decodedBlocks;
+	// Blocks invalidated since the last fetch, freed by the next one.
+	std::vector<std::vector<DecodedInstruction>> retiredBlocks;
+	void checkIrq();
+	// For CLI and PLP, which enable interrupts one instruction late.
+	void checkIrqAfterNext();
+	void enterInterrupt(std::uint16_t vector);
+	// Takes a pending reset, nmi or irq, leaving regPC at the first instruction of its handler.
+	void takeInterrupts();
+
+	/*
+	The slow path for pendingWork, run before the instruction at regPC. Returns false if
+	that instruction should not run yet, because of a breakpoint or because entering an
+	interrupt used up the cycles to cycleTarget. step() passes no target, so the first
+	instruction of an interrupt handler runs in the same step as entering it.
+	*/
+	bool doPendingWork(std::int64_t cycleTarget);
+
+	std::unordered_set<std::uint16_t> breakpoints;
+	// The breakpoint a run last stopped at, which the next run starts by executing.
+	int breakpointResumePC = -1;
+	TraceHandler traceHandler;
+
+	void skipIdleLoop(const std::vector<DecodedInstruction>& block);
+	// Whether an instruction can be part of an idle loop.
+	static bool readsOnly(std::uint8_t opcode);
+	template <std::uint8_t (m6502Core::*Read)(std::uint16_t)>
+	static bool isPlainRead(OpHandler handler);
+	// For the instructions readsOnly allows, whether the read goes to a bus read handler.
+	bool readsHandler(const DecodedInstruction& insn);
+	std::uint64_t idleLoopState() const;
+
+	// Idle loops are only skipped inside run(), and never past this cycle.
+	std::int64_t idleSkipTarget = 0;
+	// The idle loop block last entered and the state it was entered with, if the
+	// previous block run was that same loop.
+	int idleLoopPC = -1;
+	std::uint64_t idleLoopEntryState = 0;
+
+	// Runs instructions until cycleCount reaches cycleTarget.
+	void execute(std::int64_t cycleTarget);
+
+#if defined(M6502_JIT)
+	// Set when a write lands in a page with compiled code, checked by compiled blocks.
+	bool jitBlockInvalidated = false;
+#endif
+
+	/*
+	Handler templates. Each opcode is an addressing mode helper combined with an
+	operation. By the time a handler runs the PC has moved past the instruction and
+	the base cycles have been counted.
+	*/
+	template <std::uint8_t (m6502Core::*Read)(std::uint16_t), void (m6502Core::*Op)(std::uint8_t)>
+	static void opRead(m6502Core& cpu, std::uint16_t operand)
+	{
+		(cpu.*Op)((cpu.*Read)(operand));
+	}
+
+	template <void (m6502Core::*Write)(std::uint16_t, std::uint8_t), std::uint8_t m6502State::*Reg>
+	static void opWrite(m6502Core& cpu, std::uint16_t operand)
+	{
+		(cpu.*Write)(operand, cpu.*Reg);
+	}
+
+	template <std::uint16_t (m6502Core::*Address)(std::uint16_t), std::uint8_t (m6502Core::*Op)(std::uint8_t)>
+	static void opModify(m6502Core& cpu, std::uint16_t operand)
+	{
+		std::uint16_t addr = (cpu.*Address)(operand);
+		std::uint8_t newVal = (cpu.*Op)(cpu.addressBus.readByte(addr));
+		cpu.writeByte(addr, newVal);
+	}
+
+	template <std::uint8_t (m6502Core::*Op)(std::uint8_t)>
+	static void opModifyZeroPage(m6502Core& cpu, std::uint16_t operand)
+	{
+		std::uint8_t addr = operand & 0xFF;
+		cpu.writeZeroPage(addr, (cpu.*Op)(cpu.readZeroPage(addr)));
+	}
+
+	template <std::uint8_t (m6502Core::*Op)(std::uint8_t)>
+	static void opAccumulator(m6502Core& cpu, std::uint16_t)
+	{
+		cpu.regA = (cpu.*Op)(cpu.regA);
+	}
+
+	template <std::uint8_t m6502State::*From, std::uint8_t m6502State::*To>
+	static void opTransfer(m6502Core& cpu, std::uint16_t)
+	{
+		cpu.*To = cpu.*From;
+		cpu.setNZFlags(cpu.*To);
+	}
+
+	template <std::uint8_t m6502State::*Reg, int Delta>
+	static void opIncrement(m6502Core& cpu, std::uint16_t)
+	{
+		cpu.*Reg += Delta;
+		cpu.setNZFlags(cpu.*Reg);
+	}
+
+	template <void (m6502State::*SetFlag)(bool), bool Value>
+	static void opSetFlag(m6502Core& cpu, std::uint16_t)
+	{
+		(cpu.*SetFlag)(Value);
+	}
+
+	template <bool (m6502State::*Flag)() const, bool Value>
+	static void opBranch(m6502Core& cpu, std::uint16_t operand)
+	{
+		cpu.doBranch((cpu.*Flag)() == Value, operand);
+	}
+
+	static void opPhp(m6502Core& cpu, std::uint16_t);
+	static void opPlp(m6502Core& cpu, std::uint16_t);
+	static void opCli(m6502Core& cpu, std::uint16_t);
+	static void opPha(m6502Core& cpu, std::uint16_t);
+	static void opPla(m6502Core& cpu, std::uint16_t);
+	static void opTxs(m6502Core& cpu, std::uint16_t);
+	static void opJsr(m6502Core& cpu, std::uint16_t operand);
+	static void opJmp(m6502Core& cpu, std::uint16_t operand);
+	static void opRts(m6502Core& cpu, std::uint16_t);
+	static void opRti(m6502Core& cpu, std::uint16_t);
+	static void opNop(m6502Core& cpu, std::uint16_t);
+	static void opUnknown(m6502Core& cpu, std::uint16_t);
 
 	void doPhp();
 	void doPlp();
 
-	std::uint16_t getIndexedIndirectAddress();
-	std::uint16_t getIndirectIndexedYAddress();
-	std::uint8_t readIndexedIndirect();
-	std::uint8_t readIndirectIndexedY();
-	void writeIndirectIndexedY(std::uint8_t val);
-	void writeIndexedIndirect(std::uint8_t val);
-	std::uint8_t readZeroPageValue();
-	std::uint8_t readZeroPageXValue();
-	void writeZeroPageValue(std::uint8_t val);
-	void writeZeroPageXValue(std::uint8_t val);
-	void writeAbsolute(std::uint8_t val);
-	void writeAbsoluteY(std::uint8_t val);
-	std::uint8_t readAbsolute();
-	std::uint8_t readAbsoluteX();
-	std::uint8_t readAbsoluteY();
+	std::uint16_t getIndexedIndirectAddress(std::uint16_t operand);
+	std::uint16_t getIndirectIndexedYAddress(std::uint16_t operand);
+	std::uint16_t getZeroPageAddress(std::uint16_t operand) { return operand & 0xFF; }
+	std::uint16_t getAbsoluteAddress(std::uint16_t operand) { return operand; }
+	std::uint8_t readImmediate(std::uint16_t operand) { return operand & 0xFF; }
+	std::uint8_t readIndexedIndirect(std::uint16_t operand);
+	std::uint8_t readIndirectIndexedY(std::uint16_t operand);
+	void writeIndirectIndexedY(std::uint16_t operand, std::uint8_t val);
+	void writeIndexedIndirect(std::uint16_t operand, std::uint8_t val);
+	std::uint8_t readZeroPageValue(std::uint16_t operand);
+	std::uint8_t readZeroPageXValue(std::uint16_t operand);
+	void writeZeroPageValue(std::uint16_t operand, std::uint8_t val);
+	void writeZeroPageXValue(std::uint16_t operand, std::uint8_t val);
+	void writeAbsolute(std::uint16_t operand, std::uint8_t val);
+	void writeAbsoluteY(std::uint16_t operand, std::uint8_t val);
+	std::uint8_t readAbsolute(std::uint16_t operand);
+	std::uint8_t readAbsoluteX(std::uint16_t operand);
+	std::uint8_t readAbsoluteY(std::uint16_t operand);
 	void doADC(std::uint8_t val);
+	void doSBC(std::uint8_t val);
+	void doBinaryADC(std::uint8_t val);
+	void setDecimalResult(std::uint16_t entry);
 	void doAND(std::uint8_t val);
 	void doEOR(std::uint8_t val);
 	void doORA(std::uint8_t val);
 	void doCMP(std::uint8_t val);
 	void doCPX(std::uint8_t val);
 	void doCPY(std::uint8_t val);
+	void doBIT(std::uint8_t val);
+	void doLDA(std::uint8_t val) { regA = val; setNZFlags(val); }
+	void doLDX(std::uint8_t val) { regX = val; setNZFlags(val); }
+	void doLDY(std::uint8_t val) { regY = val; setNZFlags(val); }
 	std::uint8_t doROL(std::uint8_t val);
 	std::uint8_t doROR(std::uint8_t val);
 	std::uint8_t doASL(std::uint8_t val);
 	std::uint8_t doLSR(std::uint8_t val);
+	std::uint8_t doINC(std::uint8_t val) { setNZFlags(val + 1); return val + 1; }
+	std::uint8_t doDEC(std::uint8_t val) { setNZFlags(val - 1); return val - 1; }
+
+	/*
+	Zero page and the stack page go straight to host memory when the bus says they are
+	plain memory and they are not in the code cache. The pointers are looked up again by
+	reset() and at the start of each run(), so the bus's memory map should only change
+	between runs.
+	*/
+	std::uint8_t* zeroPage = nullptr;
+	std::uint8_t* stackPage = nullptr;
+	void mapFastPages();
+
+	std::uint8_t readZeroPage(std::uint8_t address)
+	{
+		return zeroPage != nullptr ? zeroPage[address] : addressBus.readByte(address);
+	}
+
+	void writeZeroPage(std::uint8_t address, std::uint8_t val)
+	{
+		if (zeroPage != nullptr) {
+			zeroPage[address] = val;
+		}
+		else {
+			writeByte(address, val);
+		}
+	}
+
+	// Pointers in zero page, which carry on into page one from $FF.
+	std::uint16_t readZeroPageWord(std::uint8_t address)
+	{
+		if (zeroPage != nullptr && address != 0xFF) {
+			return zeroPage[address] | (zeroPage[address + 1] << 8);
+		}
+		return addressBus.readWord(address);
+	}
 
 	void pushByte(std::uint8_t val);
 	std::uint8_t popByte();
@@ -80,12 +464,34 @@ private:
 	void pushShort(std::uint16_t val);
 	void doBranch(bool predicate, std::int8_t offset);
 
+#if defined(M6502_LAZY_FLAGS)
+	void setZResult(std::uint8_t val) { zResult = val; }
+	void setNResult(std::uint8_t val) { nResult = val; }
+
 	void setNZFlags(std::uint8_t val){
-				zFlag = val == 0;
-				nFlag = val >= 0x80;
+				setZResult(val);
+				setNResult(val);
 		}
+#else
+	void setZResult(std::uint8_t val) { setZero(val == 0); }
+	void setNResult(std::uint8_t val) { setNegative(val >= 0x80); }
+
+	void setNZFlags(std::uint8_t val){
+				regP = (regP & 0x7D) | (val & 0x80) | (val == 0 ? 0x02 : 0);
+		}
+#endif
 
 private:
-	AddressBus & addressBus;
+	Bus & addressBus;
+#if defined(M6502_JIT)
+	// Declared after addressBus so it is constructed after it.
+	std::unique_ptr<m6502Jit<Bus>> jit;
+#endif
+
+};
 
+class m6502 : public m6502Core<AddressBus>
+{
+public:
+	m6502(AddressBus& ab) : m6502Core<AddressBus>(ab) {}
 };
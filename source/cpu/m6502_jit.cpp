@@ -0,0 +1,608 @@
+#include "m6502_jit.h"
+#include "../direct_address_bus.h"
+
+#if defined(M6502_JIT)
+
+#include <sys/mman.h>
+
+/*
+Host register usage inside a block. rbx holds the cpu pointer. All of these are
+callee saved in the System V ABI so they survive calls into the handlers.
+*/
+static const int HOST_RBX = 3;
+static const int HOST_REG_A = 12;
+static const int HOST_REG_X = 13;
+static const int HOST_REG_Y = 14;
+
+template <class Bus>
+m6502Jit<Bus>::m6502Jit(m6502Core<Bus>& cpuIn) : cpu(cpuIn), writtenPages()
+{
+	// The buffer is never writable and executable at the same time, see setWritable.
+	void* mem = mmap(nullptr, CODE_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED) {
+		// No memory for code, leave everything to the interpreter.
+		codeBuffer = nullptr;
+		codeStart = codeEnd = writePtr = nullptr;
+	}
+	else {
+		codeBuffer = static_cast<std::uint8_t*>(mem);
+		codeStart = codeBuffer + SCRATCH_SIZE;
+		codeEnd = codeBuffer + CODE_BUFFER_SIZE;
+		writePtr = codeStart;
+	}
+	bufferWritable = true;
+
+	offsetA = offsetOf(&cpu.regA);
+	offsetX = offsetOf(&cpu.regX);
+	offsetY = offsetOf(&cpu.regY);
+	offsetSP = offsetOf(&cpu.regSP);
+	offsetPC = offsetOf(&cpu.regPC);
+	offsetCycles = offsetOf(&cpu.cycleCount);
+	offsetP = offsetOf(&cpu.regP);
+#if defined(M6502_LAZY_FLAGS)
+	offsetZ = offsetOf(&cpu.zResult);
+	offsetN = offsetOf(&cpu.nResult);
+#else
+	offsetZ = offsetN = offsetP;
+#endif
+	offsetInvalidated = offsetOf(&cpu.jitBlockInvalidated);
+}
+
+template <class Bus>
+m6502Jit<Bus>::~m6502Jit()
+{
+	if (codeBuffer != nullptr) {
+		munmap(codeBuffer, CODE_BUFFER_SIZE);
+	}
+}
+
+template <class Bus>
+int m6502Jit<Bus>::offsetOf(const void* member) const
+{
+	return static_cast<int>(static_cast<const std::uint8_t*>(member) - reinterpret_cast<const std::uint8_t*>(&cpu));
+}
+
+template <class Bus>
+bool m6502Jit<Bus>::setWritable(bool writable)
+{
+	if (writable != bufferWritable) {
+		if (mprotect(codeBuffer, CODE_BUFFER_SIZE, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC) != 0) {
+			return false;
+		}
+		bufferWritable = writable;
+	}
+	return true;
+}
+
+template <class Bus>
+bool m6502Jit<Bus>::runBlock(int cyclesLeft)
+{
+	if (codeBuffer == nullptr) {
+		return false;
+	}
+	std::uint16_t pc = cpu.regPC;
+	if (!cpu.cacheablePages[pc >> 8] || writtenPages[pc >> 8]) {
+		return false;
+	}
+	// Only the starts of blocks the interpreter has decoded are counted, not every
+	// instruction it steps through inside one.
+	if ((cpu.nextDecoded != nullptr && cpu.nextDecoded->pc == pc) || cpu.decodedBlocks.count(pc) == 0) {
+		return false;
+	}
+
+	auto found = blocks.find(pc);
+	if (found == blocks.end()) {
+		blocks.emplace(pc, Block{ nullptr, 0, 1 });
+		return false;
+	}
+	if (found->second.code == nullptr) {
+		if (found->second.hits < 0 || ++found->second.hits < HOT_BLOCK_THRESHOLD) {
+			return false;
+		}
+		int cycles = 0;
+		BlockCode code = compile(pc, cycles);
+		// Compiling may have flushed the cache so look the block up again.
+		Block& block = blocks[pc];
+		block.code = code;
+		block.cycles = cycles;
+		block.hits = code == nullptr ? -1 : HOT_BLOCK_THRESHOLD;
+		if (code == nullptr) {
+			return false;
+		}
+		found = blocks.find(pc);
+	}
+
+	const Block& block = found->second;
+	if (block.cycles > cyclesLeft || bufferWritable) {
+		return false;
+	}
+	cpu.jitBlockInvalidated = false;
+	block.code(&cpu);
+	return true;
+}
+
+template <class Bus>
+bool m6502Jit<Bus>::runInstruction()
+{
+	if (codeBuffer == nullptr) {
+		return false;
+	}
+	const DecodedInstruction& insn = cpu.fetch();
+
+	std::uint8_t* blockWritePtr = writePtr;
+	writePtr = codeBuffer;
+	int cycles = 0;
+	bool translated = setWritable(true) && translate(&insn, &insn + 1, cycles);
+	translated = setWritable(false) && translated;
+	writePtr = blockWritePtr;
+
+	if (translated) {
+		reinterpret_cast<BlockCode>(codeBuffer)(&cpu);
+	}
+	else {
+		// Unknown opcodes and CLI, PLP and RTI are left to their handlers.
+		const typename m6502Core<Bus>::OpHandler handler = insn.handler;
+		cpu.regPC += insn.length;
+		cpu.cycleCount += insn.cycles;
+		handler(cpu, insn.operand);
+	}
+	return true;
+}
+
+template <class Bus>
+void m6502Jit<Bus>::invalidatePage(int page)
+{
+	writtenPages[page] = true;
+	for (auto blockPC : pageBlocks[page]) {
+		blocks.erase(blockPC);
+	}
+	pageBlocks[page].clear();
+	cpu.jitBlockInvalidated = true;
+}
+
+template <class Bus>
+void m6502Jit<Bus>::flush()
+{
+	blocks.clear();
+	for (auto& pageList : pageBlocks) {
+		pageList.clear();
+	}
+	writePtr = codeStart;
+}
+
+template <class Bus>
+bool m6502Jit<Bus>::blockFitsPages(std::uint16_t startPC)
+{
+	for (const auto& insn : cpu.decodeBlock(startPC)) {
+		if (writtenPages[insn.pc >> 8] || writtenPages[((insn.pc + insn.length) >> 8) & 0xFF]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+template <class Bus>
+typename m6502Jit<Bus>::BlockCode m6502Jit<Bus>::compile(std::uint16_t startPC, int& cycles)
+{
+	if (!blockFitsPages(startPC)) {
+		return nullptr;
+	}
+	if (codeEnd - writePtr < MAX_BLOCK_CODE) {
+		flush();
+	}
+
+	const std::vector<DecodedInstruction>& decoded = cpu.decodeBlock(startPC);
+	if (decoded.front().idleCycles != 0) {
+		// Idle loops are left to the interpreter, which skips over them.
+		return nullptr;
+	}
+	std::uint8_t* code = writePtr;
+	bool translated = setWritable(true) && translate(decoded.data(), decoded.data() + decoded.size(), cycles);
+	if (!setWritable(false) || !translated) {
+		writePtr = code;
+		return nullptr;
+	}
+
+	for (const auto& insn : decoded) {
+		int firstPage = insn.pc >> 8;
+		int lastPage = ((insn.pc + (insn.length > 0 ? insn.length - 1 : 0)) >> 8) & 0xFF;
+		for (int page : { firstPage, lastPage }) {
+			if (pageBlocks[page].empty() || pageBlocks[page].back() != startPC) {
+				pageBlocks[page].push_back(startPC);
+			}
+		}
+	}
+	return reinterpret_cast<BlockCode>(code);
+}
+
+// CLI, PLP and RTI can clear the interrupt disable flag and take an irq straight away.
+static bool mayTakeIrq(std::uint8_t opcode)
+{
+	return opcode == 0x58 || opcode == 0x28 || opcode == 0x40;
+}
+
+template <class Bus>
+bool m6502Jit<Bus>::translate(const DecodedInstruction* begin, const DecodedInstruction* end, int& cycles)
+{
+	if (begin == end || begin->length == 0 || mayTakeIrq(begin->opcode)) {
+		return false;
+	}
+
+	emitPrologue();
+	cycles = 0;
+	// Cycles already added to cycleCount ahead of a call into a handler.
+	int committed = 0;
+	int nextPC = begin->pc;
+	bool calledOut = false;
+	for (const DecodedInstruction* insn = begin; insn != end; ++insn) {
+		if (insn->length == 0 || mayTakeIrq(insn->opcode)) {
+			// Leave unknown opcodes, and those that can let an irq in, to the interpreter.
+			break;
+		}
+		cycles += insn->cycles;
+		nextPC = (insn->pc + insn->length) & 0xFFFF;
+		calledOut = false;
+
+		switch (insn->opcode)
+		{
+			case 0xa9:
+				emitMovImm(HOST_REG_A, insn->operand & 0xFF);
+				emitSetNZConst(insn->operand & 0xFF);
+				break;
+			case 0xa2:
+				emitMovImm(HOST_REG_X, insn->operand & 0xFF);
+				emitSetNZConst(insn->operand & 0xFF);
+				break;
+			case 0xa0:
+				emitMovImm(HOST_REG_Y, insn->operand & 0xFF);
+				emitSetNZConst(insn->operand & 0xFF);
+				break;
+			case 0xaa:
+				emitMovReg(HOST_REG_X, HOST_REG_A);
+				emitSetNZ(HOST_REG_X);
+				break;
+			case 0xa8:
+				emitMovReg(HOST_REG_Y, HOST_REG_A);
+				emitSetNZ(HOST_REG_Y);
+				break;
+			case 0x8a:
+				emitMovReg(HOST_REG_A, HOST_REG_X);
+				emitSetNZ(HOST_REG_A);
+				break;
+			case 0x98:
+				emitMovReg(HOST_REG_A, HOST_REG_Y);
+				emitSetNZ(HOST_REG_A);
+				break;
+			case 0x9a:
+				emitStoreReg(HOST_REG_X, offsetSP);
+				break;
+			case 0xe8:
+				emitIncReg(HOST_REG_X, false);
+				emitSetNZ(HOST_REG_X);
+				break;
+			case 0xc8:
+				emitIncReg(HOST_REG_Y, false);
+				emitSetNZ(HOST_REG_Y);
+				break;
+			case 0xca:
+				emitIncReg(HOST_REG_X, true);
+				emitSetNZ(HOST_REG_X);
+				break;
+			case 0x88:
+				emitIncReg(HOST_REG_Y, true);
+				emitSetNZ(HOST_REG_Y);
+				break;
+			case 0x18:
+				emitSetBits(offsetP, 0x01, false);
+				break;
+			case 0x38:
+				emitSetBits(offsetP, 0x01, true);
+				break;
+			case 0xd8:
+				emitSetBits(offsetP, 0x08, false);
+				break;
+			case 0xf8:
+				emitSetBits(offsetP, 0x08, true);
+				break;
+			case 0x78:
+				emitSetBits(offsetP, 0x04, true);
+				break;
+			case 0xea:
+				break;
+			case 0x4c:
+				emitExit(cycles - committed, insn->operand);
+				return true;
+			case 0x10: case 0x30: case 0x50: case 0x70:
+			case 0x90: case 0xb0: case 0xd0: case 0xf0:
+				{
+					// Bits 6 and 7 select the flag, bit 5 the value that takes the branch.
+					const std::uint8_t flagMasks[] = { 0x80, 0x40, 0x01, 0x02 };
+					std::uint8_t flagMask = flagMasks[insn->opcode >> 6];
+					bool takenValue = (insn->opcode & 0x20) == 0x20;
+
+					int targetAddr = nextPC + static_cast<std::int8_t>(insn->operand);
+					int penalty = (targetAddr & 0xFF00) != (nextPC & 0xFF00) ? 2 : 1;
+
+#if defined(M6502_LAZY_FLAGS)
+					// Z and N hold the last result rather than a bit of P.
+					std::uint8_t* taken;
+					if (flagMask == 0x02) {
+						taken = emitJumpIfBits(offsetZ, 0xFF, !takenValue);
+					}
+					else if (flagMask == 0x80) {
+						taken = emitJumpIfBits(offsetN, 0x80, takenValue);
+					}
+					else {
+						taken = emitJumpIfBits(offsetP, flagMask, takenValue);
+					}
+#else
+					std::uint8_t* taken = emitJumpIfBits(offsetP, flagMask, takenValue);
+#endif
+					emitExit(cycles - committed, nextPC);
+					patchJump(taken);
+					emitExit(cycles - committed + penalty, targetAddr & 0xFFFF);
+				}
+				return true;
+			default:
+				{
+					// Hand the instruction to the interpreter's handler.
+					emitStoreReg(HOST_REG_A, offsetA);
+					emitStoreReg(HOST_REG_X, offsetX);
+					emitStoreReg(HOST_REG_Y, offsetY);
+					emitStoreImm16(offsetPC, nextPC);
+					// Handlers and the read and write handlers they call see the same
+					// cycleCount they would in the interpreter.
+					emitAddCycles(cycles - committed);
+					committed = cycles;
+					emitCall(reinterpret_cast<const void*>(insn->handler), insn->operand);
+					emitLoadReg(HOST_REG_A, offsetA);
+					emitLoadReg(HOST_REG_X, offsetX);
+					emitLoadReg(HOST_REG_Y, offsetY);
+					calledOut = true;
+
+					if (insn + 1 != end && (insn + 1)->length != 0) {
+						// Leave early if the handler wrote over code in this block.
+						std::uint8_t* carryOn = emitJumpIfFlag(offsetInvalidated, false);
+						emitExit(cycles - committed, nextPC);
+						patchJump(carryOn);
+					}
+				}
+				break;
+		}
+	}
+
+	// A handler at the end of the block may have changed the PC itself (JSR, RTS, RTI)
+	// and the PC has already been set to the next instruction before the call.
+	emitExit(cycles - committed, calledOut ? -1 : nextPC);
+	return true;
+}
+
+template <class Bus>
+void m6502Jit<Bus>::emit16(std::uint16_t val)
+{
+	emit8(val & 0xFF);
+	emit8(val >> 8);
+}
+
+template <class Bus>
+void m6502Jit<Bus>::emit32(std::uint32_t val)
+{
+	emit16(val & 0xFFFF);
+	emit16(val >> 16);
+}
+
+template <class Bus>
+void m6502Jit<Bus>::emit64(std::uint64_t val)
+{
+	emit32(val & 0xFFFFFFFF);
+	emit32(val >> 32);
+}
+
+template <class Bus>
+void m6502Jit<Bus>::emitModRM(int reg, int offset)
+{
+	// [rbx + disp32]
+	emit8(0x80 | ((reg & 7) << 3) | HOST_RBX);
+	emit32(offset);
+}
+
+template <class Bus>
+void m6502Jit<Bus>::emitPrologue()
+{
+	emit8(0x53);				// push rbx
+	emit8(0x41); emit8(0x54);	// push r12
+	emit8(0x41); emit8(0x55);	// push r13
+	emit8(0x41); emit8(0x56);	// push r14
+	emit8(0x41); emit8(0x57);	// push r15, keeps the stack 16 byte aligned for calls
+	emit8(0x48); emit8(0x89); emit8(0xFB);	// mov rbx, rdi
+	emitLoadReg(HOST_REG_A, offsetA);
+	emitLoadReg(HOST_REG_X, offsetX);
+	emitLoadReg(HOST_REG_Y, offsetY);
+}
+
+template <class Bus>
+void m6502Jit<Bus>::emitExit(int cycles, int nextPC)
+{
+	emitStoreReg(HOST_REG_A, offsetA);
+	emitStoreReg(HOST_REG_X, offsetX);
+	emitStoreReg(HOST_REG_Y, offsetY);
+	if (nextPC >= 0) {
+		emitStoreImm16(offsetPC, nextPC);
+	}
+	if (cycles != 0) {
+		emitAddCycles(cycles);
+	}
+	emit8(0x41); emit8(0x5F);	// pop r15
+	emit8(0x41); emit8(0x5E);	// pop r14
+	emit8(0x41); emit8(0x5D);	// pop r13
+	emit8(0x41); emit8(0x5C);	// pop r12
+	emit8(0x5B);				// pop rbx
+	emit8(0xC3);				// ret
+}
+
+template <class Bus>
+void m6502Jit<Bus>::emitLoadReg(int hostReg, int offset)
+{
+	// movzx r32, byte [rbx + offset]
+	if (hostReg >= 8) {
+		emit8(0x44);
+	}
+	emit8(0x0F); emit8(0xB6);
+	emitModRM(hostReg, offset);
+}
+
+template <class Bus>
+void m6502Jit<Bus>::emitStoreReg(int hostReg, int offset)
+{
+	// mov byte [rbx + offset], r8
+	emit8(hostReg >= 8 ? 0x44 : 0x40);
+	emit8(0x88);
+	emitModRM(hostReg, offset);
+}
+
+template <class Bus>
+void m6502Jit<Bus>::emitStoreImm8(int offset, std::uint8_t val)
+{
+	emit8(0xC6);
+	emitModRM(0, offset);
+	emit8(val);
+}
+
+template <class Bus>
+void m6502Jit<Bus>::emitStoreImm16(int offset, std::uint16_t val)
+{
+	emit8(0x66); emit8(0xC7);
+	emitModRM(0, offset);
+	emit16(val);
+}
+
+template <class Bus>
+void m6502Jit<Bus>::emitAddCycles(int cycles)
+{
+	// add qword [rbx + offset], imm32
+	emit8(0x48); emit8(0x81);
+	emitModRM(0, offsetCycles);
+	emit32(cycles);
+}
+
+template <class Bus>
+void m6502Jit<Bus>::emitMovImm(int hostReg, std::uint32_t val)
+{
+	if (hostReg >= 8) {
+		emit8(0x41);
+	}
+	emit8(0xB8 | (hostReg & 7));
+	emit32(val);
+}
+
+template <class Bus>
+void m6502Jit<Bus>::emitMovReg(int dst, int src)
+{
+	// mov r32, r32
+	emit8(0x40 | (src >= 8 ? 0x04 : 0) | (dst >= 8 ? 0x01 : 0));
+	emit8(0x89);
+	emit8(0xC0 | ((src & 7) << 3) | (dst & 7));
+}
+
+template <class Bus>
+void m6502Jit<Bus>::emitIncReg(int hostReg, bool decrement)
+{
+	// inc / dec r8. Only the low byte changes so the register stays zero extended.
+	emit8(hostReg >= 8 ? 0x41 : 0x40);
+	emit8(0xFE);
+	emit8(0xC0 | (decrement ? 0x08 : 0) | (hostReg & 7));
+}
+
+template <class Bus>
+void m6502Jit<Bus>::emitSetNZ(int hostReg)
+{
+#if defined(M6502_LAZY_FLAGS)
+	emitStoreReg(hostReg, offsetZ);
+	emitStoreReg(hostReg, offsetN);
+#else
+	int rex = hostReg >= 8 ? 0x44 : 0x40;
+	emit8(0x8A);							// mov al, byte [rbx + offsetP]
+	emitModRM(0, offsetP);
+	emit8(0x24); emit8(0x7D);				// and al, ~(N | Z)
+	emit8(rex | (hostReg >= 8 ? 0x01 : 0));	// test r8, r8
+	emit8(0x84);
+	emit8(0xC0 | ((hostReg & 7) << 3) | (hostReg & 7));
+	emit8(0x75); emit8(0x02);				// jnz +2
+	emit8(0x0C); emit8(0x02);				// or al, Z
+	emit8(rex);								// mov cl, r8
+	emit8(0x88);
+	emit8(0xC0 | ((hostReg & 7) << 3) | 1);
+	emit8(0x80); emit8(0xE1); emit8(0x80);	// and cl, N
+	emit8(0x08); emit8(0xC8);				// or al, cl
+	emit8(0x88);							// mov byte [rbx + offsetP], al
+	emitModRM(0, offsetP);
+#endif
+}
+
+template <class Bus>
+void m6502Jit<Bus>::emitSetNZConst(std::uint8_t val)
+{
+#if defined(M6502_LAZY_FLAGS)
+	emitStoreImm8(offsetZ, val);
+	emitStoreImm8(offsetN, val);
+#else
+	emitSetBits(offsetP, 0x82, false);
+	std::uint8_t bits = (val & 0x80) | (val == 0 ? 0x02 : 0);
+	if (bits != 0) {
+		emitSetBits(offsetP, bits, true);
+	}
+#endif
+}
+
+template <class Bus>
+void m6502Jit<Bus>::emitSetBits(int offset, std::uint8_t mask, bool set)
+{
+	// or / and byte [rbx + offset], imm8
+	emit8(0x80);
+	emitModRM(set ? 1 : 4, offset);
+	emit8(set ? mask : static_cast<std::uint8_t>(~mask));
+}
+
+template <class Bus>
+std::uint8_t* m6502Jit<Bus>::emitJumpIfFlag(int flagOffset, bool value)
+{
+	return emitJumpIfBits(flagOffset, 0xFF, value);
+}
+
+template <class Bus>
+std::uint8_t* m6502Jit<Bus>::emitJumpIfBits(int offset, std::uint8_t mask, bool set)
+{
+	// test byte [rbx + offset], mask then jne / je rel32
+	emit8(0xF6);
+	emitModRM(0, offset);
+	emit8(mask);
+	emit8(0x0F);
+	emit8(set ? 0x85 : 0x84);
+	std::uint8_t* jump = writePtr;
+	emit32(0);
+	return jump;
+}
+
+template <class Bus>
+void m6502Jit<Bus>::patchJump(std::uint8_t* jump)
+{
+	std::int32_t rel = static_cast<std::int32_t>(writePtr - (jump + 4));
+	for (int i = 0; i < 4; ++i) {
+		jump[i] = (rel >> (i * 8)) & 0xFF;
+	}
+}
+
+template <class Bus>
+void m6502Jit<Bus>::emitCall(const void* handler, std::uint16_t operand)
+{
+	emit8(0x48); emit8(0x89); emit8(0xDF);	// mov rdi, rbx
+	emit8(0xBE); emit32(operand);			// mov esi, operand
+	emit8(0x48); emit8(0xB8);				// mov rax, handler
+	emit64(reinterpret_cast<std::uint64_t>(handler));
+	emit8(0xFF); emit8(0xD0);				// call rax
+}
+
+template class m6502Jit<AddressBus>;
+template class m6502Jit<DirectAddressBus>;
+
+#endif
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "m6502.h"
+
+/*
+Translates basic blocks of 6502 code into x86-64 code.
+
+Only pages the cpu has been told to cache (m6502Core::enableCodeCache) are compiled, and
+only once a block has been run HOT_BLOCK_THRESHOLD times. A, X and Y are held in host
+registers for the whole block and the base cycles are added when the block exits, or
+before a call into a handler so that it sees an up to date cycleCount.
+Register, immediate, flag and branch instructions are translated directly; anything
+that touches memory calls the interpreter's handler for that opcode.
+
+Pages that are written to after code in them has been cached are never compiled
+again and are left to the interpreter, as is anything outside the cached pages.
+
+The code buffer is only writable while code is being emitted into it and only
+executable the rest of the time.
+*/
+template <class Bus>
+class m6502Jit
+{
+public:
+	m6502Jit(m6502Core<Bus>& cpu);
+	~m6502Jit();
+
+	m6502Jit(const m6502Jit&) = delete;
+	m6502Jit& operator=(const m6502Jit&) = delete;
+
+	/**
+	 * Runs the compiled block at the cpu's PC if there is one and its base cycles fit in
+	 * cyclesLeft. Returns false if nothing was run.
+	*/
+	bool runBlock(int cyclesLeft);
+
+	/**
+	 * Translates the next instruction on its own into a scratch area and runs it. This is
+	 * what step() uses so that single stepping goes through the same code as compiled blocks.
+	 * Returns false if the instruction could not be translated.
+	*/
+	bool runInstruction();
+
+	// Drops compiled code in page and stops it from being compiled again.
+	void invalidatePage(int page);
+
+private:
+	typedef void (*BlockCode)(m6502Core<Bus>* cpu);
+	typedef typename m6502Core<Bus>::DecodedInstruction DecodedInstruction;
+
+	class Block
+	{
+	public:
+		BlockCode code;
+		int cycles;
+		int hits;
+	};
+
+	static const int HOT_BLOCK_THRESHOLD = 4;
+	static const int CODE_BUFFER_SIZE = 1024 * 1024;
+	static const int SCRATCH_SIZE = 4096;
+	static const int MAX_BLOCK_CODE = 16 * 1024;
+
+	bool blockFitsPages(std::uint16_t startPC);
+	BlockCode compile(std::uint16_t startPC, int& cycles);
+	// Switches the code buffer between writable and executable. Returns false if it couldn't.
+	bool setWritable(bool writable);
+	bool translate(const DecodedInstruction* begin, const DecodedInstruction* end, int& cycles);
+	void flush();
+
+	// x86-64 emitter
+	void emit8(std::uint8_t val) { *writePtr++ = val; }
+	void emit16(std::uint16_t val);
+	void emit32(std::uint32_t val);
+	void emit64(std::uint64_t val);
+	void emitModRM(int reg, int offset);
+	void emitPrologue();
+	void emitExit(int cycles, int nextPC);
+	void emitLoadReg(int hostReg, int offset);
+	void emitStoreReg(int hostReg, int offset);
+	void emitStoreImm8(int offset, std::uint8_t val);
+	void emitStoreImm16(int offset, std::uint16_t val);
+	void emitAddCycles(int cycles);
+	void emitMovImm(int hostReg, std::uint32_t val);
+	void emitMovReg(int dst, int src);
+	void emitIncReg(int hostReg, bool decrement);
+	void emitSetNZ(int hostReg);
+	void emitSetNZConst(std::uint8_t val);
+	void emitSetBits(int offset, std::uint8_t mask, bool set);
+	std::uint8_t* emitJumpIfFlag(int flagOffset, bool value);
+	std::uint8_t* emitJumpIfBits(int offset, std::uint8_t mask, bool set);
+	void patchJump(std::uint8_t* jump);
+	void emitCall(const void* handler, std::uint16_t operand);
+
+	int offsetOf(const void* member) const;
+
+	m6502Core<Bus>& cpu;
+
+	std::uint8_t* codeBuffer;
+	std::uint8_t* codeStart;
+	std::uint8_t* codeEnd;
+	std::uint8_t* writePtr;
+	bool bufferWritable;
+
+	bool writtenPages[256];
+	std::vector<std::uint16_t> pageBlocks[256];
+	std::unordered_map<std::uint16_t, Block> blocks;
+
+	int offsetA;
+	int offsetX;
+	int offsetY;
+	int offsetSP;
+	int offsetPC;
+	int offsetCycles;
+	int offsetP;
+	// Only separate from offsetP when lazy flags are on.
+	int offsetZ;
+	int offsetN;
+	int offsetInvalidated;
+};
@@ -0,0 +1,265 @@
+/*
+The 6502 opcode matrix. Each entry gives the opcode, the instruction length in bytes,
+the base cycle count and the handler that implements it. Page crossing and branch
+penalties are added by the handlers themselves.
+
+Define M6502_OPCODE(opcode, length, cycles, handler) before including this file.
+Unimplemented opcodes have a length of 0 so that the PC does not move.
+*/
+
+M6502_OPCODE(0x00, 0, 0, opUnknown)
+M6502_OPCODE(0x01, 2, 6, (opRead<&m6502Core::readIndexedIndirect, &m6502Core::doORA>))		// ORA ($nn,X)
+M6502_OPCODE(0x02, 0, 0, opUnknown)
+M6502_OPCODE(0x03, 0, 0, opUnknown)
+M6502_OPCODE(0x04, 0, 0, opUnknown)
+M6502_OPCODE(0x05, 2, 3, (opRead<&m6502Core::readZeroPageValue, &m6502Core::doORA>))		// ORA $nn
+M6502_OPCODE(0x06, 2, 5, (opModifyZeroPage<&m6502Core::doASL>))		// ASL $nn
+M6502_OPCODE(0x07, 0, 0, opUnknown)
+M6502_OPCODE(0x08, 1, 3, opPhp)		// PHP
+M6502_OPCODE(0x09, 2, 2, (opRead<&m6502Core::readImmediate, &m6502Core::doORA>))		// ORA #nn
+M6502_OPCODE(0x0a, 1, 2, (opAccumulator<&m6502Core::doASL>))		// ASL A
+M6502_OPCODE(0x0b, 0, 0, opUnknown)
+M6502_OPCODE(0x0c, 0, 0, opUnknown)
+M6502_OPCODE(0x0d, 0, 0, opUnknown)
+M6502_OPCODE(0x0e, 3, 6, (opModify<&m6502Core::getAbsoluteAddress, &m6502Core::doASL>))		// ASL $nnnn
+M6502_OPCODE(0x0f, 0, 0, opUnknown)
+M6502_OPCODE(0x10, 2, 2, (opBranch<&m6502Core::negative, false>))		// BPL $nn
+M6502_OPCODE(0x11, 0, 0, opUnknown)
+M6502_OPCODE(0x12, 0, 0, opUnknown)
+M6502_OPCODE(0x13, 0, 0, opUnknown)
+M6502_OPCODE(0x14, 0, 0, opUnknown)
+M6502_OPCODE(0x15, 0, 0, opUnknown)
+M6502_OPCODE(0x16, 0, 0, opUnknown)
+M6502_OPCODE(0x17, 0, 0, opUnknown)
+M6502_OPCODE(0x18, 1, 2, (opSetFlag<&m6502Core::setCarry, false>))		// CLC
+M6502_OPCODE(0x19, 0, 0, opUnknown)
+M6502_OPCODE(0x1a, 0, 0, opUnknown)
+M6502_OPCODE(0x1b, 0, 0, opUnknown)
+M6502_OPCODE(0x1c, 0, 0, opUnknown)
+M6502_OPCODE(0x1d, 0, 0, opUnknown)
+M6502_OPCODE(0x1e, 0, 0, opUnknown)
+M6502_OPCODE(0x1f, 0, 0, opUnknown)
+M6502_OPCODE(0x20, 3, 6, opJsr)		// JSR $nnnn
+M6502_OPCODE(0x21, 2, 6, (opRead<&m6502Core::readIndexedIndirect, &m6502Core::doAND>))		// AND ($nn,X)
+M6502_OPCODE(0x22, 0, 0, opUnknown)
+M6502_OPCODE(0x23, 0, 0, opUnknown)
+M6502_OPCODE(0x24, 2, 3, (opRead<&m6502Core::readZeroPageValue, &m6502Core::doBIT>))		// BIT $nn
+M6502_OPCODE(0x25, 2, 3, (opRead<&m6502Core::readZeroPageValue, &m6502Core::doAND>))		// AND $nn
+M6502_OPCODE(0x26, 2, 5, (opModifyZeroPage<&m6502Core::doROL>))		// ROL $nn
+M6502_OPCODE(0x27, 0, 0, opUnknown)
+M6502_OPCODE(0x28, 1, 4, opPlp)		// PLP
+M6502_OPCODE(0x29, 2, 2, (opRead<&m6502Core::readImmediate, &m6502Core::doAND>))		// AND #nn
+M6502_OPCODE(0x2a, 0, 0, opUnknown)
+M6502_OPCODE(0x2b, 0, 0, opUnknown)
+M6502_OPCODE(0x2c, 0, 0, opUnknown)
+M6502_OPCODE(0x2d, 0, 0, opUnknown)
+M6502_OPCODE(0x2e, 0, 0, opUnknown)
+M6502_OPCODE(0x2f, 0, 0, opUnknown)
+M6502_OPCODE(0x30, 2, 2, (opBranch<&m6502Core::negative, true>))		// BMI $nn
+M6502_OPCODE(0x31, 0, 0, opUnknown)
+M6502_OPCODE(0x32, 0, 0, opUnknown)
+M6502_OPCODE(0x33, 0, 0, opUnknown)
+M6502_OPCODE(0x34, 0, 0, opUnknown)
+M6502_OPCODE(0x35, 0, 0, opUnknown)
+M6502_OPCODE(0x36, 0, 0, opUnknown)
+M6502_OPCODE(0x37, 0, 0, opUnknown)
+M6502_OPCODE(0x38, 1, 2, (opSetFlag<&m6502Core::setCarry, true>))		// SEC
+M6502_OPCODE(0x39, 0, 0, opUnknown)
+M6502_OPCODE(0x3a, 0, 0, opUnknown)
+M6502_OPCODE(0x3b, 0, 0, opUnknown)
+M6502_OPCODE(0x3c, 0, 0, opUnknown)
+M6502_OPCODE(0x3d, 0, 0, opUnknown)
+M6502_OPCODE(0x3e, 0, 0, opUnknown)
+M6502_OPCODE(0x3f, 0, 0, opUnknown)
+M6502_OPCODE(0x40, 1, 6, opRti)		// RTI
+M6502_OPCODE(0x41, 2, 6, (opRead<&m6502Core::readIndexedIndirect, &m6502Core::doEOR>))		// EOR ($nn,X)
+M6502_OPCODE(0x42, 0, 0, opUnknown)
+M6502_OPCODE(0x43, 0, 0, opUnknown)
+M6502_OPCODE(0x44, 0, 0, opUnknown)
+M6502_OPCODE(0x45, 2, 3, (opRead<&m6502Core::readZeroPageValue, &m6502Core::doEOR>))		// EOR $nn
+M6502_OPCODE(0x46, 2, 5, (opModifyZeroPage<&m6502Core::doLSR>))		// LSR $nn
+M6502_OPCODE(0x47, 0, 0, opUnknown)
+M6502_OPCODE(0x48, 1, 3, opPha)		// PHA
+M6502_OPCODE(0x49, 2, 2, (opRead<&m6502Core::readImmediate, &m6502Core::doEOR>))		// EOR #nn
+M6502_OPCODE(0x4a, 1, 2, (opAccumulator<&m6502Core::doLSR>))		// LSR A
+M6502_OPCODE(0x4b, 0, 0, opUnknown)
+M6502_OPCODE(0x4c, 3, 3, opJmp)		// JMP $nnnn
+M6502_OPCODE(0x4d, 0, 0, opUnknown)
+M6502_OPCODE(0x4e, 0, 0, opUnknown)
+M6502_OPCODE(0x4f, 0, 0, opUnknown)
+M6502_OPCODE(0x50, 2, 2, (opBranch<&m6502Core::overflow, false>))		// BVC $nn
+M6502_OPCODE(0x51, 0, 0, opUnknown)
+M6502_OPCODE(0x52, 0, 0, opUnknown)
+M6502_OPCODE(0x53, 0, 0, opUnknown)
+M6502_OPCODE(0x54, 0, 0, opUnknown)
+M6502_OPCODE(0x55, 0, 0, opUnknown)
+M6502_OPCODE(0x56, 0, 0, opUnknown)
+M6502_OPCODE(0x57, 0, 0, opUnknown)
+M6502_OPCODE(0x58, 1, 2, opCli)		// CLI
+M6502_OPCODE(0x59, 0, 0, opUnknown)
+M6502_OPCODE(0x5a, 0, 0, opUnknown)
+M6502_OPCODE(0x5b, 0, 0, opUnknown)
+M6502_OPCODE(0x5c, 0, 0, opUnknown)
+M6502_OPCODE(0x5d, 3, 4, (opRead<&m6502Core::readAbsoluteX, &m6502Core::doEOR>))		// EOR $nnnn, X
+M6502_OPCODE(0x5e, 0, 0, opUnknown)
+M6502_OPCODE(0x5f, 0, 0, opUnknown)
+M6502_OPCODE(0x60, 1, 6, opRts)		// RTS
+M6502_OPCODE(0x61, 0, 0, opUnknown)
+M6502_OPCODE(0x62, 0, 0, opUnknown)
+M6502_OPCODE(0x63, 0, 0, opUnknown)
+M6502_OPCODE(0x64, 0, 0, opUnknown)
+M6502_OPCODE(0x65, 2, 3, (opRead<&m6502Core::readZeroPageValue, &m6502Core::doADC>))		// ADC $nn
+M6502_OPCODE(0x66, 0, 0, opUnknown)
+M6502_OPCODE(0x67, 0, 0, opUnknown)
+M6502_OPCODE(0x68, 1, 4, opPla)		// PLA
+M6502_OPCODE(0x69, 2, 2, (opRead<&m6502Core::readImmediate, &m6502Core::doADC>))		// ADC #nn
+M6502_OPCODE(0x6a, 1, 2, (opAccumulator<&m6502Core::doROR>))		// ROR A
+M6502_OPCODE(0x6b, 0, 0, opUnknown)
+M6502_OPCODE(0x6c, 0, 0, opUnknown)
+M6502_OPCODE(0x6d, 0, 0, opUnknown)
+M6502_OPCODE(0x6e, 0, 0, opUnknown)
+M6502_OPCODE(0x6f, 0, 0, opUnknown)
+M6502_OPCODE(0x70, 0, 0, opUnknown)
+M6502_OPCODE(0x71, 0, 0, opUnknown)
+M6502_OPCODE(0x72, 0, 0, opUnknown)
+M6502_OPCODE(0x73, 0, 0, opUnknown)
+M6502_OPCODE(0x74, 0, 0, opUnknown)
+M6502_OPCODE(0x75, 0, 0, opUnknown)
+M6502_OPCODE(0x76, 0, 0, opUnknown)
+M6502_OPCODE(0x77, 0, 0, opUnknown)
+M6502_OPCODE(0x78, 1, 2, (opSetFlag<&m6502Core::setInterruptDisable, true>))		// SEI
+M6502_OPCODE(0x79, 0, 0, opUnknown)
+M6502_OPCODE(0x7a, 0, 0, opUnknown)
+M6502_OPCODE(0x7b, 0, 0, opUnknown)
+M6502_OPCODE(0x7c, 0, 0, opUnknown)
+M6502_OPCODE(0x7d, 3, 4, (opRead<&m6502Core::readAbsoluteX, &m6502Core::doADC>))		// ADC $nnnn, X
+M6502_OPCODE(0x7e, 0, 0, opUnknown)
+M6502_OPCODE(0x7f, 0, 0, opUnknown)
+M6502_OPCODE(0x80, 0, 0, opUnknown)
+M6502_OPCODE(0x81, 2, 6, (opWrite<&m6502Core::writeIndexedIndirect, &m6502Core::regA>))		// STA ($nn,X)
+M6502_OPCODE(0x82, 0, 0, opUnknown)
+M6502_OPCODE(0x83, 0, 0, opUnknown)
+M6502_OPCODE(0x84, 2, 3, (opWrite<&m6502Core::writeZeroPageValue, &m6502Core::regY>))		// STY $nn
+M6502_OPCODE(0x85, 2, 3, (opWrite<&m6502Core::writeZeroPageValue, &m6502Core::regA>))		// STA $nn
+M6502_OPCODE(0x86, 2, 3, (opWrite<&m6502Core::writeZeroPageValue, &m6502Core::regX>))		// STX $nn
+M6502_OPCODE(0x87, 0, 0, opUnknown)
+M6502_OPCODE(0x88, 1, 2, (opIncrement<&m6502Core::regY, -1>))		// DEY
+M6502_OPCODE(0x89, 0, 0, opUnknown)
+M6502_OPCODE(0x8a, 1, 2, (opTransfer<&m6502Core::regX, &m6502Core::regA>))		// TXA
+M6502_OPCODE(0x8b, 0, 0, opUnknown)
+M6502_OPCODE(0x8c, 0, 0, opUnknown)
+M6502_OPCODE(0x8d, 3, 4, (opWrite<&m6502Core::writeAbsolute, &m6502Core::regA>))		// STA $nnnn
+M6502_OPCODE(0x8e, 0, 0, opUnknown)
+M6502_OPCODE(0x8f, 0, 0, opUnknown)
+M6502_OPCODE(0x90, 2, 2, (opBranch<&m6502Core::carry, false>))		// BCC $nn
+M6502_OPCODE(0x91, 2, 6, (opWrite<&m6502Core::writeIndirectIndexedY, &m6502Core::regA>))		// STA ($nn), Y
+M6502_OPCODE(0x92, 0, 0, opUnknown)
+M6502_OPCODE(0x93, 0, 0, opUnknown)
+M6502_OPCODE(0x94, 0, 0, opUnknown)
+M6502_OPCODE(0x95, 2, 4, (opWrite<&m6502Core::writeZeroPageXValue, &m6502Core::regA>))		// STA $nn, X
+M6502_OPCODE(0x96, 0, 0, opUnknown)
+M6502_OPCODE(0x97, 0, 0, opUnknown)
+M6502_OPCODE(0x98, 1, 2, (opTransfer<&m6502Core::regY, &m6502Core::regA>))		// TYA
+M6502_OPCODE(0x99, 3, 5, (opWrite<&m6502Core::writeAbsoluteY, &m6502Core::regA>))		// STA $nnnn, Y
+M6502_OPCODE(0x9a, 1, 2, opTxs)		// TXS
+M6502_OPCODE(0x9b, 0, 0, opUnknown)
+M6502_OPCODE(0x9c, 0, 0, opUnknown)
+M6502_OPCODE(0x9d, 0, 0, opUnknown)
+M6502_OPCODE(0x9e, 0, 0, opUnknown)
+M6502_OPCODE(0x9f, 0, 0, opUnknown)
+M6502_OPCODE(0xa0, 2, 2, (opRead<&m6502Core::readImmediate, &m6502Core::doLDY>))		// LDY #nn
+M6502_OPCODE(0xa1, 0, 0, opUnknown)
+M6502_OPCODE(0xa2, 2, 2, (opRead<&m6502Core::readImmediate, &m6502Core::doLDX>))		// LDX #nn
+M6502_OPCODE(0xa3, 0, 0, opUnknown)
+M6502_OPCODE(0xa4, 2, 3, (opRead<&m6502Core::readZeroPageValue, &m6502Core::doLDY>))		// LDY $nn
+M6502_OPCODE(0xa5, 2, 3, (opRead<&m6502Core::readZeroPageValue, &m6502Core::doLDA>))		// LDA $nn
+M6502_OPCODE(0xa6, 2, 3, (opRead<&m6502Core::readZeroPageValue, &m6502Core::doLDX>))		// LDX $nn
+M6502_OPCODE(0xa7, 0, 0, opUnknown)
+M6502_OPCODE(0xa8, 1, 2, (opTransfer<&m6502Core::regA, &m6502Core::regY>))		// TAY
+M6502_OPCODE(0xa9, 2, 2, (opRead<&m6502Core::readImmediate, &m6502Core::doLDA>))		// LDA #nn
+M6502_OPCODE(0xaa, 1, 2, (opTransfer<&m6502Core::regA, &m6502Core::regX>))		// TAX
+M6502_OPCODE(0xab, 0, 0, opUnknown)
+M6502_OPCODE(0xac, 0, 0, opUnknown)
+M6502_OPCODE(0xad, 3, 4, (opRead<&m6502Core::readAbsolute, &m6502Core::doLDA>))		// LDA $nnnn
+M6502_OPCODE(0xae, 0, 0, opUnknown)
+M6502_OPCODE(0xaf, 0, 0, opUnknown)
+M6502_OPCODE(0xb0, 2, 2, (opBranch<&m6502Core::carry, true>))		// BCS $nn
+M6502_OPCODE(0xb1, 2, 5, (opRead<&m6502Core::readIndirectIndexedY, &m6502Core::doLDA>))		// LDA ($nn), Y
+M6502_OPCODE(0xb2, 0, 0, opUnknown)
+M6502_OPCODE(0xb3, 0, 0, opUnknown)
+M6502_OPCODE(0xb4, 2, 4, (opRead<&m6502Core::readZeroPageXValue, &m6502Core::doLDY>))		// LDY $nn, X
+M6502_OPCODE(0xb5, 2, 4, (opRead<&m6502Core::readZeroPageXValue, &m6502Core::doLDA>))		// LDA $nn, X
+M6502_OPCODE(0xb6, 0, 0, opUnknown)
+M6502_OPCODE(0xb7, 0, 0, opUnknown)
+M6502_OPCODE(0xb8, 0, 0, opUnknown)
+M6502_OPCODE(0xb9, 3, 4, (opRead<&m6502Core::readAbsoluteY, &m6502Core::doLDA>))		// LDA $nnnn, Y
+M6502_OPCODE(0xba, 0, 0, opUnknown)
+M6502_OPCODE(0xbb, 0, 0, opUnknown)
+M6502_OPCODE(0xbc, 3, 4, (opRead<&m6502Core::readAbsoluteX, &m6502Core::doLDY>))		// LDY $nnnn, X
+M6502_OPCODE(0xbd, 3, 4, (opRead<&m6502Core::readAbsoluteX, &m6502Core::doLDA>))		// LDA $nnnn, X
+M6502_OPCODE(0xbe, 0, 0, opUnknown)
+M6502_OPCODE(0xbf, 0, 0, opUnknown)
+M6502_OPCODE(0xc0, 0, 0, opUnknown)
+M6502_OPCODE(0xc1, 0, 0, opUnknown)
+M6502_OPCODE(0xc2, 0, 0, opUnknown)
+M6502_OPCODE(0xc3, 0, 0, opUnknown)
+M6502_OPCODE(0xc4, 0, 0, opUnknown)
+M6502_OPCODE(0xc5, 2, 3, (opRead<&m6502Core::readZeroPageValue, &m6502Core::doCMP>))		// CMP $nn
+M6502_OPCODE(0xc6, 2, 5, (opModifyZeroPage<&m6502Core::doDEC>))		// DEC $nn
+M6502_OPCODE(0xc7, 0, 0, opUnknown)
+M6502_OPCODE(0xc8, 1, 2, (opIncrement<&m6502Core::regY, 1>))		// INY
+M6502_OPCODE(0xc9, 2, 2, (opRead<&m6502Core::readImmediate, &m6502Core::doCMP>))		// CMP #nn
+M6502_OPCODE(0xca, 1, 2, (opIncrement<&m6502Core::regX, -1>))		// DEX
+M6502_OPCODE(0xcb, 0, 0, opUnknown)
+M6502_OPCODE(0xcc, 3, 4, (opRead<&m6502Core::readAbsolute, &m6502Core::doCPY>))		// CPY $nnnn
+M6502_OPCODE(0xcd, 0, 0, opUnknown)
+M6502_OPCODE(0xce, 0, 0, opUnknown)
+M6502_OPCODE(0xcf, 0, 0, opUnknown)
+M6502_OPCODE(0xd0, 2, 2, (opBranch<&m6502Core::zero, false>))		// BNE $nn
+M6502_OPCODE(0xd1, 0, 0, opUnknown)
+M6502_OPCODE(0xd2, 0, 0, opUnknown)
+M6502_OPCODE(0xd3, 0, 0, opUnknown)
+M6502_OPCODE(0xd4, 0, 0, opUnknown)
+M6502_OPCODE(0xd5, 0, 0, opUnknown)
+M6502_OPCODE(0xd6, 0, 0, opUnknown)
+M6502_OPCODE(0xd7, 0, 0, opUnknown)
+M6502_OPCODE(0xd8, 1, 2, (opSetFlag<&m6502Core::setDecimalMode, false>))		// CLD
+M6502_OPCODE(0xd9, 3, 4, (opRead<&m6502Core::readAbsoluteY, &m6502Core::doCMP>))		// CMP $nnnn, Y
+M6502_OPCODE(0xda, 0, 0, opUnknown)
+M6502_OPCODE(0xdb, 0, 0, opUnknown)
+M6502_OPCODE(0xdc, 0, 0, opUnknown)
+M6502_OPCODE(0xdd, 3, 4, (opRead<&m6502Core::readAbsoluteX, &m6502Core::doCMP>))		// CMP $nnnn, X
+M6502_OPCODE(0xde, 0, 0, opUnknown)
+M6502_OPCODE(0xdf, 0, 0, opUnknown)
+M6502_OPCODE(0xe0, 2, 2, (opRead<&m6502Core::readImmediate, &m6502Core::doCPX>))		// CPX #nn
+M6502_OPCODE(0xe1, 0, 0, opUnknown)
+M6502_OPCODE(0xe2, 0, 0, opUnknown)
+M6502_OPCODE(0xe3, 0, 0, opUnknown)
+M6502_OPCODE(0xe4, 0, 0, opUnknown)
+M6502_OPCODE(0xe5, 2, 3, (opRead<&m6502Core::readZeroPageValue, &m6502Core::doSBC>))		// SBC $nn
+M6502_OPCODE(0xe6, 2, 5, (opModifyZeroPage<&m6502Core::doINC>))		// INC $nn
+M6502_OPCODE(0xe7, 0, 0, opUnknown)
+M6502_OPCODE(0xe8, 1, 2, (opIncrement<&m6502Core::regX, 1>))		// INX
+M6502_OPCODE(0xe9, 2, 2, (opRead<&m6502Core::readImmediate, &m6502Core::doSBC>))		// SBC #nn
+M6502_OPCODE(0xea, 1, 2, opNop)		// NOP
+M6502_OPCODE(0xeb, 0, 0, opUnknown)
+M6502_OPCODE(0xec, 0, 0, opUnknown)
+M6502_OPCODE(0xed, 3, 4, (opRead<&m6502Core::readAbsolute, &m6502Core::doSBC>))		// SBC $nnnn
+M6502_OPCODE(0xee, 0, 0, opUnknown)
+M6502_OPCODE(0xef, 0, 0, opUnknown)
+M6502_OPCODE(0xf0, 2, 2, (opBranch<&m6502Core::zero, true>))		// BEQ $nn
+M6502_OPCODE(0xf1, 0, 0, opUnknown)
+M6502_OPCODE(0xf2, 0, 0, opUnknown)
+M6502_OPCODE(0xf3, 0, 0, opUnknown)
+M6502_OPCODE(0xf4, 0, 0, opUnknown)
+M6502_OPCODE(0xf5, 0, 0, opUnknown)
+M6502_OPCODE(0xf6, 0, 0, opUnknown)
+M6502_OPCODE(0xf7, 0, 0, opUnknown)
+M6502_OPCODE(0xf8, 1, 2, (opSetFlag<&m6502Core::setDecimalMode, true>))		// SED
+M6502_OPCODE(0xf9, 0, 0, opUnknown)
+M6502_OPCODE(0xfa, 0, 0, opUnknown)
+M6502_OPCODE(0xfb, 0, 0, opUnknown)
+M6502_OPCODE(0xfc, 0, 0, opUnknown)
+M6502_OPCODE(0xfd, 0, 0, opUnknown)
+M6502_OPCODE(0xfe, 0, 0, opUnknown)
+M6502_OPCODE(0xff, 0, 0, opUnknown)
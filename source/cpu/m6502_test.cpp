@@ -4,6 +4,7 @@
 #include "m6502.h"
 #include "../ram.h"
 #include "../direct_address_bus.h"
+#include "../scheduler.h"
 
 // run with m6502_test --log_level=message for detailed output
 
@@ -129,7 +130,7 @@ BOOST_AUTO_TEST_CASE(test_absx_instructions)
 	M6502TestCase tests[]{
 		//flags, opcode, lo, hi, memval, A, X, Y, desc, cycles, AOut, XOut, YOut, flagsOut
 		// 0x70 + 0x10 + carry. Extensive tests for ADC are in the zval case. 
-		M6502TestCase("c---z", 0x7d, 0x34, 0x12, 0x70, 0x10, 0x22, 0x33, "ADC $1234, X", 4, 0x81, 0x22, 0x33, "---v-"),
+		M6502TestCase("c---z", 0x7d, 0x34, 0x12, 0x70, 0x10, 0x22, 0x33, "ADC $1234, X", 4, 0x81, 0x22, 0x33, "--nv-"),
 		M6502TestCase("c---z", 0xbc, 0x34, 0x12, 0x70, 0x10, 0x33, 0x00, "LDY $1234, X", 4, 0x70, 0x10, 0x33, 0x70, "c----"),
 		M6502TestCase("c----", 0xbc, 0x34, 0x12, 0x00, 0x10, 0xE0, 0x00, "LDY $1234, X", 5, 0x00, 0x10, 0xE0, 0x00, "c---z"),
 		M6502TestCase("----z", 0xbc, 0x34, 0x12, 0x80, 0x10, 0x33, 0x00, "LDY $1234, X", 4, 0x80, 0x10, 0x33, 0x80, "-n---"),
@@ -170,11 +171,11 @@ BOOST_AUTO_TEST_CASE(test_absx_instructions)
 		cpu.regX = testcase.regX;
 		cpu.regY = testcase.regY;
 		cpu.regPC = 0x0123;
-		cpu.cFlag = testcase.flagsIn.find('c') != std::string::npos;
-		cpu.decimalMode = testcase.flagsIn.find('d') != std::string::npos;
-		cpu.nFlag = testcase.flagsIn.find('n') != std::string::npos;
-		cpu.vFlag = testcase.flagsIn.find('v') != std::string::npos;
-		cpu.zFlag = testcase.flagsIn.find('z') != std::string::npos;
+		cpu.setCarry(testcase.flagsIn.find('c') != std::string::npos);
+		cpu.setDecimalMode(testcase.flagsIn.find('d') != std::string::npos);
+		cpu.setNegative(testcase.flagsIn.find('n') != std::string::npos);
+		cpu.setOverflow(testcase.flagsIn.find('v') != std::string::npos);
+		cpu.setZero(testcase.flagsIn.find('z') != std::string::npos);
 		cpu.step();
 
 		BOOST_CHECK_EQUAL(ram.bytes[absval + testcase.regX], testcase.expectedMemval);
@@ -183,11 +184,11 @@ BOOST_AUTO_TEST_CASE(test_absx_instructions)
 		BOOST_CHECK_EQUAL(cpu.regY, testcase.expectedRegY);
 		BOOST_CHECK_EQUAL(cpu.regPC, 0x126);
 		BOOST_CHECK_EQUAL(cpu.cycleCount, testcase.expectedCycles);
-		BOOST_CHECK_EQUAL(cpu.cFlag, testcase.expectedFlags.find('c') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.decimalMode, testcase.expectedFlags.find('d') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.nFlag, testcase.expectedFlags.find('n') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.vFlag, testcase.expectedFlags.find('v') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.zFlag, testcase.expectedFlags.find('z') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.carry(), testcase.expectedFlags.find('c') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.decimalMode(), testcase.expectedFlags.find('d') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.negative(), testcase.expectedFlags.find('n') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.overflow(), testcase.expectedFlags.find('v') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.zero(), testcase.expectedFlags.find('z') != std::string::npos);
 	}
 }
 
@@ -236,11 +237,11 @@ BOOST_AUTO_TEST_CASE(test_absy_instructions)
 		cpu.regX = testcase.regX;
 		cpu.regY = testcase.regY;
 		cpu.regPC = 0x0123;
-		cpu.cFlag = testcase.flagsIn.find('c') != std::string::npos;
-		cpu.decimalMode = testcase.flagsIn.find('d') != std::string::npos;
-		cpu.nFlag = testcase.flagsIn.find('n') != std::string::npos;
-		cpu.vFlag = testcase.flagsIn.find('v') != std::string::npos;
-		cpu.zFlag = testcase.flagsIn.find('z') != std::string::npos;
+		cpu.setCarry(testcase.flagsIn.find('c') != std::string::npos);
+		cpu.setDecimalMode(testcase.flagsIn.find('d') != std::string::npos);
+		cpu.setNegative(testcase.flagsIn.find('n') != std::string::npos);
+		cpu.setOverflow(testcase.flagsIn.find('v') != std::string::npos);
+		cpu.setZero(testcase.flagsIn.find('z') != std::string::npos);
 		cpu.step();
 
 		BOOST_CHECK_EQUAL(ram.bytes[absval + testcase.regY], testcase.expectedMemval);
@@ -249,11 +250,11 @@ BOOST_AUTO_TEST_CASE(test_absy_instructions)
 		BOOST_CHECK_EQUAL(cpu.regY, testcase.expectedRegY);
 		BOOST_CHECK_EQUAL(cpu.regPC, 0x126);
 		BOOST_CHECK_EQUAL(cpu.cycleCount, testcase.expectedCycles);
-		BOOST_CHECK_EQUAL(cpu.cFlag, testcase.expectedFlags.find('c') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.decimalMode, testcase.expectedFlags.find('d') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.nFlag, testcase.expectedFlags.find('n') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.vFlag, testcase.expectedFlags.find('v') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.zFlag, testcase.expectedFlags.find('z') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.carry(), testcase.expectedFlags.find('c') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.decimalMode(), testcase.expectedFlags.find('d') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.negative(), testcase.expectedFlags.find('n') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.overflow(), testcase.expectedFlags.find('v') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.zero(), testcase.expectedFlags.find('z') != std::string::npos);
 	}
 }
 
@@ -301,11 +302,11 @@ BOOST_AUTO_TEST_CASE(test_abs_instructions)
 		cpu.regX = testcase.regX;
 		cpu.regY = testcase.regY;
 		cpu.regPC = 0x0123;
-		cpu.cFlag = testcase.flagsIn.find('c') != std::string::npos;
-		cpu.decimalMode = testcase.flagsIn.find('d') != std::string::npos;
-		cpu.nFlag = testcase.flagsIn.find('n') != std::string::npos;
-		cpu.vFlag = testcase.flagsIn.find('v') != std::string::npos;
-		cpu.zFlag = testcase.flagsIn.find('z') != std::string::npos;
+		cpu.setCarry(testcase.flagsIn.find('c') != std::string::npos);
+		cpu.setDecimalMode(testcase.flagsIn.find('d') != std::string::npos);
+		cpu.setNegative(testcase.flagsIn.find('n') != std::string::npos);
+		cpu.setOverflow(testcase.flagsIn.find('v') != std::string::npos);
+		cpu.setZero(testcase.flagsIn.find('z') != std::string::npos);
 		cpu.step();
 
 		BOOST_CHECK_EQUAL(ram.bytes[absval], testcase.expectedMemval);
@@ -314,11 +315,11 @@ BOOST_AUTO_TEST_CASE(test_abs_instructions)
 		BOOST_CHECK_EQUAL(cpu.regY, testcase.expectedRegY);
 		BOOST_CHECK_EQUAL(cpu.regPC, 0x126);
 		BOOST_CHECK_EQUAL(cpu.cycleCount, testcase.expectedCycles);
-		BOOST_CHECK_EQUAL(cpu.cFlag, testcase.expectedFlags.find('c') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.decimalMode, testcase.expectedFlags.find('d') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.nFlag, testcase.expectedFlags.find('n') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.vFlag, testcase.expectedFlags.find('v') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.zFlag, testcase.expectedFlags.find('z') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.carry(), testcase.expectedFlags.find('c') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.decimalMode(), testcase.expectedFlags.find('d') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.negative(), testcase.expectedFlags.find('n') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.overflow(), testcase.expectedFlags.find('v') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.zero(), testcase.expectedFlags.find('z') != std::string::npos);
 	}
 }
 
@@ -364,11 +365,11 @@ BOOST_AUTO_TEST_CASE(test_zpagex_instructions)
 		cpu.regX = testcase.regX;
 		cpu.regY = testcase.regY;
 		cpu.regPC = 0x0123;
-		cpu.cFlag = testcase.flagsIn.find('c') != std::string::npos;
-		cpu.decimalMode = testcase.flagsIn.find('d') != std::string::npos;
-		cpu.nFlag = testcase.flagsIn.find('n') != std::string::npos;
-		cpu.vFlag = testcase.flagsIn.find('v') != std::string::npos;
-		cpu.zFlag = testcase.flagsIn.find('z') != std::string::npos;
+		cpu.setCarry(testcase.flagsIn.find('c') != std::string::npos);
+		cpu.setDecimalMode(testcase.flagsIn.find('d') != std::string::npos);
+		cpu.setNegative(testcase.flagsIn.find('n') != std::string::npos);
+		cpu.setOverflow(testcase.flagsIn.find('v') != std::string::npos);
+		cpu.setZero(testcase.flagsIn.find('z') != std::string::npos);
 		cpu.step();
 
 		BOOST_CHECK_EQUAL(ram.bytes[zxaddr], testcase.expectedMemval);
@@ -377,11 +378,11 @@ BOOST_AUTO_TEST_CASE(test_zpagex_instructions)
 		BOOST_CHECK_EQUAL(cpu.regY, testcase.expectedRegY);
 		BOOST_CHECK_EQUAL(cpu.regPC, 0x125);
 		BOOST_CHECK_EQUAL(cpu.cycleCount, testcase.expectedCycles);
-		BOOST_CHECK_EQUAL(cpu.cFlag, testcase.expectedFlags.find('c') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.decimalMode, testcase.expectedFlags.find('d') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.nFlag, testcase.expectedFlags.find('n') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.vFlag, testcase.expectedFlags.find('v') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.zFlag, testcase.expectedFlags.find('z') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.carry(), testcase.expectedFlags.find('c') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.decimalMode(), testcase.expectedFlags.find('d') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.negative(), testcase.expectedFlags.find('n') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.overflow(), testcase.expectedFlags.find('v') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.zero(), testcase.expectedFlags.find('z') != std::string::npos);
 	}
 }
 
@@ -426,11 +427,11 @@ BOOST_AUTO_TEST_CASE(test_indirect_indexed_y_instructions)
 		cpu.regX = testcase.regX;
 		cpu.regY = testcase.regY;
 		cpu.regPC = 0x0123;
-		cpu.cFlag = testcase.flagsIn.find('c') != std::string::npos;
-		cpu.decimalMode = testcase.flagsIn.find('d') != std::string::npos;
-		cpu.nFlag = testcase.flagsIn.find('n') != std::string::npos;
-		cpu.vFlag = testcase.flagsIn.find('v') != std::string::npos;
-		cpu.zFlag = testcase.flagsIn.find('z') != std::string::npos;
+		cpu.setCarry(testcase.flagsIn.find('c') != std::string::npos);
+		cpu.setDecimalMode(testcase.flagsIn.find('d') != std::string::npos);
+		cpu.setNegative(testcase.flagsIn.find('n') != std::string::npos);
+		cpu.setOverflow(testcase.flagsIn.find('v') != std::string::npos);
+		cpu.setZero(testcase.flagsIn.find('z') != std::string::npos);
 		cpu.step();
 
 		BOOST_CHECK_EQUAL(ram.bytes[targetAddr], testcase.expectedMemval);
@@ -439,11 +440,11 @@ BOOST_AUTO_TEST_CASE(test_indirect_indexed_y_instructions)
 		BOOST_CHECK_EQUAL(cpu.regY, testcase.expectedRegY);
 		BOOST_CHECK_EQUAL(cpu.regPC, 0x125);
 		BOOST_CHECK_EQUAL(cpu.cycleCount, testcase.expectedCycles);
-		BOOST_CHECK_EQUAL(cpu.cFlag, testcase.expectedFlags.find('c') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.decimalMode, testcase.expectedFlags.find('d') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.nFlag, testcase.expectedFlags.find('n') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.vFlag, testcase.expectedFlags.find('v') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.zFlag, testcase.expectedFlags.find('z') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.carry(), testcase.expectedFlags.find('c') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.decimalMode(), testcase.expectedFlags.find('d') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.negative(), testcase.expectedFlags.find('n') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.overflow(), testcase.expectedFlags.find('v') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.zero(), testcase.expectedFlags.find('z') != std::string::npos);
 	}
 }
 
@@ -453,20 +454,22 @@ BOOST_AUTO_TEST_CASE(test_zpage_instructions)
 		//flags, opcode, zval, A, desc, cycles, AOut, flagsOut
 		M6502TestCase("c---z", 0x65, 0x15, 0x11, "ADC $10", 3, 0x11 + 0x15 + 0x01, "-----"),
 		// two positives overflow to a negative
-		M6502TestCase("----z", 0x65, 0x70, 0x10, "ADC $10", 3, 0x80, "---v-"),
+		M6502TestCase("----z", 0x65, 0x70, 0x10, "ADC $10", 3, 0x80, "--nv-"),
 		// two negatives overflow to a positive
 		M6502TestCase("----z", 0x65, 0x80, 0xE0, "ADC $10", 3, 0x60, "c--v-"),
 		M6502TestCase("----z", 0x65, 0x70, 0x90, "ADC $10", 3, 0x00, "c---z"),
 
-		// Decimal mode
-		M6502TestCase("-d--z", 0x65, 0x16, 0x75, "ADC $10", 3, 0x91, "-d-v-"),
-		M6502TestCase("-d--z", 0x65, 0x16, 0x85, "ADC $10", 3, 0x01, "cd---"),
-		M6502TestCase("cd--z", 0x65, 0x16, 0x85, "ADC $10", 3, 0x02, "cd---"),
+		// Decimal mode. N and V come from the sum before the high nibble is adjusted.
+		M6502TestCase("-d--z", 0x65, 0x16, 0x75, "ADC $10", 3, 0x91, "-dnv-"),
+		M6502TestCase("-d--z", 0x65, 0x16, 0x85, "ADC $10", 3, 0x01, "cdn--"),
+		M6502TestCase("cd--z", 0x65, 0x16, 0x85, "ADC $10", 3, 0x02, "cdn--"),
+		// Z comes from the binary sum, so 99 + 01 is 00 with Z clear.
+		M6502TestCase("-d--z", 0x65, 0x01, 0x99, "ADC $10", 3, 0x00, "cdn--"),
 
 		//flags, opcode, zval, A, desc, cycles, AOut, flagsOut
 		M6502TestCase("----z", 0xe5, 0x05, 0x11, "SBC $10", 3, 0x11 - 0x05 - 0x01, "c----"),
 		// two positives to a negative .. which is correct
-		M6502TestCase("c---z", 0xe5, 0x20, 0x10, "SBC $10", 3, 0xF0, "-----"),
+		M6502TestCase("c---z", 0xe5, 0x20, 0x10, "SBC $10", 3, 0xF0, "--n--"),
 		// two negatives overflow to a positive
 		M6502TestCase("c---z", 0xe5, 0x01, 0x80, "SBC $10", 3, 0x7F, "c--v-"),
 		M6502TestCase("c---z", 0xe5, 0x90, 0x90, "SBC $10", 3, 0x00, "c---z"),
@@ -475,6 +478,7 @@ BOOST_AUTO_TEST_CASE(test_zpage_instructions)
 		M6502TestCase("cd--z", 0xe5, 0x14, 0x85, "SBC $10", 3, 0x71, "cd-v-"),
 		M6502TestCase("cd--z", 0xe5, 0x84, 0x85, "SBC $10", 3, 0x01, "cd---"),
 		M6502TestCase("-d--z", 0xe5, 0x12, 0x85, "SBC $10", 3, 0x72, "cd-v-"),
+		M6502TestCase("cd--z", 0xe5, 0x01, 0x00, "SBC $10", 3, 0x99, "-dn--"),
 
 		M6502TestCase("-----", 0xc5, 0x16, 0x75, "CMP $10", 3, 0x75, "c----"),
 		M6502TestCase("-----", 0xc5, 0x75, 0x75, "CMP $10", 3, 0x75, "c---z"),
@@ -505,21 +509,21 @@ BOOST_AUTO_TEST_CASE(test_zpage_instructions)
 		cpu.cycleCount = 0;
 		cpu.regA = testcase.regA;
 		cpu.regPC = 0x0123;
-		cpu.cFlag = testcase.flagsIn.find('c') != std::string::npos;
-		cpu.decimalMode = testcase.flagsIn.find('d') != std::string::npos;
-		cpu.nFlag = testcase.flagsIn.find('n') != std::string::npos;
-		cpu.vFlag = testcase.flagsIn.find('v') != std::string::npos;
-		cpu.zFlag = testcase.flagsIn.find('z') != std::string::npos;
+		cpu.setCarry(testcase.flagsIn.find('c') != std::string::npos);
+		cpu.setDecimalMode(testcase.flagsIn.find('d') != std::string::npos);
+		cpu.setNegative(testcase.flagsIn.find('n') != std::string::npos);
+		cpu.setOverflow(testcase.flagsIn.find('v') != std::string::npos);
+		cpu.setZero(testcase.flagsIn.find('z') != std::string::npos);
 		cpu.step();
 
 		BOOST_CHECK_EQUAL(cpu.regA, testcase.expectedRegA);
 		BOOST_CHECK_EQUAL(cpu.regPC, 0x125);
 		BOOST_CHECK_EQUAL(cpu.cycleCount, testcase.expectedCycles);
-		BOOST_CHECK_EQUAL(cpu.cFlag, testcase.expectedFlags.find('c') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.decimalMode, testcase.expectedFlags.find('d') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.nFlag, testcase.expectedFlags.find('n') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.vFlag, testcase.expectedFlags.find('v') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.zFlag, testcase.expectedFlags.find('z') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.carry(), testcase.expectedFlags.find('c') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.decimalMode(), testcase.expectedFlags.find('d') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.negative(), testcase.expectedFlags.find('n') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.overflow(), testcase.expectedFlags.find('v') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.zero(), testcase.expectedFlags.find('z') != std::string::npos);
 	}
 }
 
@@ -576,11 +580,11 @@ BOOST_AUTO_TEST_CASE(test_extended_zpage_instructions)
 		cpu.regX = testcase.regX;
 		cpu.regY = testcase.regY;
 		cpu.regPC = 0x0123;
-		cpu.cFlag = testcase.flagsIn.find('c') != std::string::npos;
-		cpu.decimalMode = testcase.flagsIn.find('d') != std::string::npos;
-		cpu.nFlag = testcase.flagsIn.find('n') != std::string::npos;
-		cpu.vFlag = testcase.flagsIn.find('v') != std::string::npos;
-		cpu.zFlag = testcase.flagsIn.find('z') != std::string::npos;
+		cpu.setCarry(testcase.flagsIn.find('c') != std::string::npos);
+		cpu.setDecimalMode(testcase.flagsIn.find('d') != std::string::npos);
+		cpu.setNegative(testcase.flagsIn.find('n') != std::string::npos);
+		cpu.setOverflow(testcase.flagsIn.find('v') != std::string::npos);
+		cpu.setZero(testcase.flagsIn.find('z') != std::string::npos);
 		cpu.step();
 
 		BOOST_CHECK_EQUAL(cpu.regA, testcase.expectedRegA);
@@ -589,11 +593,11 @@ BOOST_AUTO_TEST_CASE(test_extended_zpage_instructions)
 		BOOST_CHECK_EQUAL(ram.bytes[testcase.value1], testcase.value2);
 		BOOST_CHECK_EQUAL(cpu.regPC, 0x125);
 		BOOST_CHECK_EQUAL(cpu.cycleCount, testcase.expectedCycles);
-		BOOST_CHECK_EQUAL(cpu.cFlag, testcase.expectedFlags.find('c') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.decimalMode, testcase.expectedFlags.find('d') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.nFlag, testcase.expectedFlags.find('n') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.vFlag, testcase.expectedFlags.find('v') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.zFlag, testcase.expectedFlags.find('z') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.carry(), testcase.expectedFlags.find('c') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.decimalMode(), testcase.expectedFlags.find('d') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.negative(), testcase.expectedFlags.find('n') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.overflow(), testcase.expectedFlags.find('v') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.zero(), testcase.expectedFlags.find('z') != std::string::npos);
 	}
 }
 
@@ -645,11 +649,11 @@ BOOST_AUTO_TEST_CASE(test_imm_instructions)
 		cpu.regX = testcase.regX;
 		cpu.regY = testcase.regY;
 		cpu.regPC = 0x0123;
-		cpu.cFlag = testcase.flagsIn.find('c') != std::string::npos;
-		cpu.decimalMode = testcase.flagsIn.find('d') != std::string::npos;
-		cpu.nFlag = testcase.flagsIn.find('n') != std::string::npos;
-		cpu.vFlag = testcase.flagsIn.find('v') != std::string::npos;
-		cpu.zFlag = testcase.flagsIn.find('z') != std::string::npos;
+		cpu.setCarry(testcase.flagsIn.find('c') != std::string::npos);
+		cpu.setDecimalMode(testcase.flagsIn.find('d') != std::string::npos);
+		cpu.setNegative(testcase.flagsIn.find('n') != std::string::npos);
+		cpu.setOverflow(testcase.flagsIn.find('v') != std::string::npos);
+		cpu.setZero(testcase.flagsIn.find('z') != std::string::npos);
 		cpu.step();
 
 		BOOST_CHECK_EQUAL(cpu.regA, testcase.expectedRegA);
@@ -657,11 +661,11 @@ BOOST_AUTO_TEST_CASE(test_imm_instructions)
 		BOOST_CHECK_EQUAL(cpu.regY, testcase.expectedRegY);
 		BOOST_CHECK_EQUAL(cpu.regPC, 0x125);
 		BOOST_CHECK_EQUAL(cpu.cycleCount, testcase.expectedCycles);
-		BOOST_CHECK_EQUAL(cpu.cFlag, testcase.expectedFlags.find('c') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.decimalMode, testcase.expectedFlags.find('d') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.nFlag, testcase.expectedFlags.find('n') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.vFlag, testcase.expectedFlags.find('v') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.zFlag, testcase.expectedFlags.find('z') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.carry(), testcase.expectedFlags.find('c') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.decimalMode(), testcase.expectedFlags.find('d') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.negative(), testcase.expectedFlags.find('n') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.overflow(), testcase.expectedFlags.find('v') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.zero(), testcase.expectedFlags.find('z') != std::string::npos);
 	}
 }
 
@@ -699,21 +703,21 @@ BOOST_AUTO_TEST_CASE(test_acc_instructions)
 		cpu.cycleCount = 0;
 		cpu.regA = testcase.regA;
 		cpu.regPC = 0x0123;
-		cpu.cFlag = testcase.flagsIn.find('c') != std::string::npos;
-		cpu.decimalMode = testcase.flagsIn.find('d') != std::string::npos;
-		cpu.nFlag = testcase.flagsIn.find('n') != std::string::npos;
-		cpu.vFlag = testcase.flagsIn.find('v') != std::string::npos;
-		cpu.zFlag = testcase.flagsIn.find('z') != std::string::npos;
+		cpu.setCarry(testcase.flagsIn.find('c') != std::string::npos);
+		cpu.setDecimalMode(testcase.flagsIn.find('d') != std::string::npos);
+		cpu.setNegative(testcase.flagsIn.find('n') != std::string::npos);
+		cpu.setOverflow(testcase.flagsIn.find('v') != std::string::npos);
+		cpu.setZero(testcase.flagsIn.find('z') != std::string::npos);
 		cpu.step();
 
 		BOOST_CHECK_EQUAL(cpu.regA, testcase.expectedRegA);
 		BOOST_CHECK_EQUAL(cpu.regPC, 0x124);
 		BOOST_CHECK_EQUAL(cpu.cycleCount, testcase.expectedCycles);
-		BOOST_CHECK_EQUAL(cpu.cFlag, testcase.expectedFlags.find('c') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.decimalMode, testcase.expectedFlags.find('d') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.nFlag, testcase.expectedFlags.find('n') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.vFlag, testcase.expectedFlags.find('v') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.zFlag, testcase.expectedFlags.find('z') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.carry(), testcase.expectedFlags.find('c') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.decimalMode(), testcase.expectedFlags.find('d') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.negative(), testcase.expectedFlags.find('n') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.overflow(), testcase.expectedFlags.find('v') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.zero(), testcase.expectedFlags.find('z') != std::string::npos);
 	}
 }
 
@@ -775,11 +779,11 @@ BOOST_AUTO_TEST_CASE(test_reg_instructions)
 		cpu.regY = testcase.regY;
 		cpu.regSP = testcase.regSP;
 		cpu.regPC = 0x0123;
-		cpu.cFlag = testcase.flagsIn.find('c') != std::string::npos;
-		cpu.decimalMode = testcase.flagsIn.find('d') != std::string::npos;
-		cpu.nFlag = testcase.flagsIn.find('n') != std::string::npos;
-		cpu.vFlag = testcase.flagsIn.find('v') != std::string::npos;
-		cpu.zFlag = testcase.flagsIn.find('z') != std::string::npos;
+		cpu.setCarry(testcase.flagsIn.find('c') != std::string::npos);
+		cpu.setDecimalMode(testcase.flagsIn.find('d') != std::string::npos);
+		cpu.setNegative(testcase.flagsIn.find('n') != std::string::npos);
+		cpu.setOverflow(testcase.flagsIn.find('v') != std::string::npos);
+		cpu.setZero(testcase.flagsIn.find('z') != std::string::npos);
 		cpu.step();
 
 		BOOST_CHECK_EQUAL(cpu.regA, testcase.expectedRegA);
@@ -788,11 +792,11 @@ BOOST_AUTO_TEST_CASE(test_reg_instructions)
 		BOOST_CHECK_EQUAL(cpu.regPC, 0x124);
 		BOOST_CHECK_EQUAL(cpu.regSP, testcase.expectedRegSP);
 		BOOST_CHECK_EQUAL(cpu.cycleCount, testcase.expectedCycles);
-		BOOST_CHECK_EQUAL(cpu.cFlag, testcase.expectedFlags.find('c') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.decimalMode, testcase.expectedFlags.find('d') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.nFlag, testcase.expectedFlags.find('n') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.vFlag, testcase.expectedFlags.find('v') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.zFlag, testcase.expectedFlags.find('z') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.carry(), testcase.expectedFlags.find('c') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.decimalMode(), testcase.expectedFlags.find('d') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.negative(), testcase.expectedFlags.find('n') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.overflow(), testcase.expectedFlags.find('v') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.zero(), testcase.expectedFlags.find('z') != std::string::npos);
 	}
 }
 
@@ -834,11 +838,11 @@ BOOST_AUTO_TEST_CASE(test_indexed_indirect_instructions)
 		cpu.regX = testcase.regX;
 		cpu.regY = testcase.regY;
 		cpu.regPC = 0x0123;
-		cpu.cFlag = testcase.flagsIn.find('c') != std::string::npos;
-		cpu.decimalMode = testcase.flagsIn.find('d') != std::string::npos;
-		cpu.nFlag = testcase.flagsIn.find('n') != std::string::npos;
-		cpu.vFlag = testcase.flagsIn.find('v') != std::string::npos;
-		cpu.zFlag = testcase.flagsIn.find('z') != std::string::npos;
+		cpu.setCarry(testcase.flagsIn.find('c') != std::string::npos);
+		cpu.setDecimalMode(testcase.flagsIn.find('d') != std::string::npos);
+		cpu.setNegative(testcase.flagsIn.find('n') != std::string::npos);
+		cpu.setOverflow(testcase.flagsIn.find('v') != std::string::npos);
+		cpu.setZero(testcase.flagsIn.find('z') != std::string::npos);
 		cpu.step();
 
 		BOOST_CHECK_EQUAL(cpu.regA, testcase.expectedRegA);
@@ -847,11 +851,11 @@ BOOST_AUTO_TEST_CASE(test_indexed_indirect_instructions)
 		BOOST_CHECK_EQUAL(ram.bytes[0x2345], testcase.value2);
 		BOOST_CHECK_EQUAL(cpu.regPC, 0x125);
 		BOOST_CHECK_EQUAL(cpu.cycleCount, testcase.expectedCycles);
-		BOOST_CHECK_EQUAL(cpu.cFlag, testcase.expectedFlags.find('c') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.decimalMode, testcase.expectedFlags.find('d') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.nFlag, testcase.expectedFlags.find('n') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.vFlag, testcase.expectedFlags.find('v') != std::string::npos);
-		BOOST_CHECK_EQUAL(cpu.zFlag, testcase.expectedFlags.find('z') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.carry(), testcase.expectedFlags.find('c') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.decimalMode(), testcase.expectedFlags.find('d') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.negative(), testcase.expectedFlags.find('n') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.overflow(), testcase.expectedFlags.find('v') != std::string::npos);
+		BOOST_CHECK_EQUAL(cpu.zero(), testcase.expectedFlags.find('z') != std::string::npos);
 	}
 }
 
@@ -879,16 +883,16 @@ BOOST_AUTO_TEST_CASE(test_asl_instructions)
 	cpu.cycleCount = 0;
 	cpu.regA = 0x11;
 	cpu.regPC = 0x0123;
-	cpu.nFlag = false;
-	cpu.zFlag = true;
-	cpu.cFlag = false;
+	cpu.setNegative(false);
+	cpu.setZero(true);
+	cpu.setCarry(false);
 	cpu.step();
 	BOOST_CHECK_EQUAL(cpu.regA, 0x11);
 	BOOST_CHECK_EQUAL(ram.bytes[0x10], 0x86);
 	BOOST_CHECK_EQUAL(cpu.cycleCount, 5);
-	BOOST_CHECK(cpu.nFlag);
-	BOOST_CHECK(!cpu.zFlag);
-	BOOST_CHECK(cpu.cFlag);
+	BOOST_CHECK(cpu.negative());
+	BOOST_CHECK(!cpu.zero());
+	BOOST_CHECK(cpu.carry());
 
 	ram.bytes[0x0123] = 0x0A;		// ASL A
 
@@ -946,16 +950,16 @@ BOOST_AUTO_TEST_CASE(test_lsr_instructions)
 	cpu.cycleCount = 0;
 	cpu.regA = 0x11;
 	cpu.regPC = 0x0123;
-	cpu.nFlag = false;
-	cpu.zFlag = true;
-	cpu.cFlag = false;
+	cpu.setNegative(false);
+	cpu.setZero(true);
+	cpu.setCarry(false);
 	cpu.step();
 	BOOST_CHECK_EQUAL(cpu.regA, 0x11);
 	BOOST_CHECK_EQUAL(ram.bytes[0x10], 0x61);
 	BOOST_CHECK_EQUAL(cpu.cycleCount, 5);
-	BOOST_CHECK(!cpu.nFlag);
-	BOOST_CHECK(!cpu.zFlag);
-	BOOST_CHECK(cpu.cFlag);
+	BOOST_CHECK(!cpu.negative());
+	BOOST_CHECK(!cpu.zero());
+	BOOST_CHECK(cpu.carry());
 
 	ram.bytes[0x0123] = 0x4A;		// LSR A
 
@@ -994,31 +998,31 @@ BOOST_AUTO_TEST_CASE(test_rol_instructions)
 	cpu.cycleCount = 0;
 	cpu.regA = 0x11;
 	cpu.regPC = 0x0123;
-	cpu.nFlag = false;
-	cpu.zFlag = true;
-	cpu.cFlag = true;
+	cpu.setNegative(false);
+	cpu.setZero(true);
+	cpu.setCarry(true);
 	cpu.step();
 	BOOST_CHECK_EQUAL(cpu.regA, 0x11);
 	BOOST_CHECK_EQUAL(ram.bytes[0x10], 0x87);
 	BOOST_CHECK_EQUAL(cpu.cycleCount, 5);
-	BOOST_CHECK(cpu.nFlag);
-	BOOST_CHECK(!cpu.zFlag);
-	BOOST_CHECK(cpu.cFlag);
+	BOOST_CHECK(cpu.negative());
+	BOOST_CHECK(!cpu.zero());
+	BOOST_CHECK(cpu.carry());
 
 	ram.bytes[0x10] = 0xC3;
 	cpu.cycleCount = 0;
 	cpu.regA = 0x11;
 	cpu.regPC = 0x0123;
-	cpu.nFlag = false;
-	cpu.zFlag = true;
-	cpu.cFlag = false;
+	cpu.setNegative(false);
+	cpu.setZero(true);
+	cpu.setCarry(false);
 	cpu.step();
 	BOOST_CHECK_EQUAL(cpu.regA, 0x11);
 	BOOST_CHECK_EQUAL(ram.bytes[0x10], 0x86);
 	BOOST_CHECK_EQUAL(cpu.cycleCount, 5);
-	BOOST_CHECK(cpu.nFlag);
-	BOOST_CHECK(!cpu.zFlag);
-	BOOST_CHECK(cpu.cFlag);
+	BOOST_CHECK(cpu.negative());
+	BOOST_CHECK(!cpu.zero());
+	BOOST_CHECK(cpu.carry());
 }
 
 BOOST_AUTO_TEST_CASE(test_and_instructions)
@@ -1048,33 +1052,33 @@ BOOST_AUTO_TEST_CASE(test_and_instructions)
 	cpu.regA = 0x33;
 	cpu.regX = 1;
 	cpu.regPC = 0x0123;
-	cpu.nFlag = true;
-	cpu.zFlag = true;
+	cpu.setNegative(true);
+	cpu.setZero(true);
 	cpu.step();
 	BOOST_CHECK_EQUAL(cpu.regA, 0x13);
 	BOOST_CHECK_EQUAL(cpu.cycleCount, 6);
-	BOOST_CHECK(!cpu.nFlag);
-	BOOST_CHECK(!cpu.zFlag);
+	BOOST_CHECK(!cpu.negative());
+	BOOST_CHECK(!cpu.zero());
 
 	// result is negative
 	cpu.regPC = 0x0123;
 	cpu.regA = 0x80;
 	ram.bytes[0x1211] = 0x83;
-	cpu.nFlag = false;
-	cpu.zFlag = true;
+	cpu.setNegative(false);
+	cpu.setZero(true);
 	cpu.step();
-	BOOST_CHECK(cpu.nFlag);
-	BOOST_CHECK(!cpu.zFlag);
+	BOOST_CHECK(cpu.negative());
+	BOOST_CHECK(!cpu.zero());
 
 	// result is zero
 	cpu.regPC = 0x0123;
 	cpu.regA = 0xFF;
 	ram.bytes[0x1211] = 0x0;
-	cpu.nFlag = false;
-	cpu.zFlag = true;
+	cpu.setNegative(false);
+	cpu.setZero(true);
 	cpu.step();
-	BOOST_CHECK(!cpu.nFlag);
-	BOOST_CHECK(cpu.zFlag);
+	BOOST_CHECK(!cpu.negative());
+	BOOST_CHECK(cpu.zero());
 
 	// Zero page variant. Flag setting is common, so just test the value.
 	ram.bytes[0x0123] = 0x25;		// AND $nn
@@ -1132,33 +1136,33 @@ BOOST_AUTO_TEST_CASE(test_or_instructions)
 	cpu.regA = 0x20;
 	cpu.regX = 1;
 	cpu.regPC = 0x0123;
-	cpu.nFlag = true;
-	cpu.zFlag = true;
+	cpu.setNegative(true);
+	cpu.setZero(true);
 	cpu.step();
 	BOOST_CHECK_EQUAL(cpu.regA, 0x33);
 	BOOST_CHECK_EQUAL(cpu.cycleCount, 6);
-	BOOST_CHECK(!cpu.nFlag);
-	BOOST_CHECK(!cpu.zFlag);
+	BOOST_CHECK(!cpu.negative());
+	BOOST_CHECK(!cpu.zero());
 
 	// result is negative
 	cpu.regPC = 0x0123;
 	cpu.regA = 0x20;
 	ram.bytes[0x1211] = 0x83;
-	cpu.nFlag = false;
-	cpu.zFlag = true;
+	cpu.setNegative(false);
+	cpu.setZero(true);
 	cpu.step();
-	BOOST_CHECK(cpu.nFlag);
-	BOOST_CHECK(!cpu.zFlag);
+	BOOST_CHECK(cpu.negative());
+	BOOST_CHECK(!cpu.zero());
 
 	// result is zero
 	cpu.regPC = 0x0123;
 	cpu.regA = 0x0;
 	ram.bytes[0x1211] = 0x0;
-	cpu.nFlag = false;
-	cpu.zFlag = true;
+	cpu.setNegative(false);
+	cpu.setZero(true);
 	cpu.step();
-	BOOST_CHECK(!cpu.nFlag);
-	BOOST_CHECK(cpu.zFlag);
+	BOOST_CHECK(!cpu.negative());
+	BOOST_CHECK(cpu.zero());
 
 	// Zero page variant. Flag setting is common, so just test the value.
 	ram.bytes[0x0123] = 0x05;		// ORA $nn
@@ -1215,33 +1219,33 @@ BOOST_AUTO_TEST_CASE(test_eor_instructions)
 	cpu.regA = 0x60;
 	cpu.regX = 1;
 	cpu.regPC = 0x0123;
-	cpu.nFlag = true;
-	cpu.zFlag = true;
+	cpu.setNegative(true);
+	cpu.setZero(true);
 	cpu.step();
 	BOOST_CHECK_EQUAL(cpu.regA, 0x33);
 	BOOST_CHECK_EQUAL(cpu.cycleCount, 6);
-	BOOST_CHECK(!cpu.nFlag);
-	BOOST_CHECK(!cpu.zFlag);
+	BOOST_CHECK(!cpu.negative());
+	BOOST_CHECK(!cpu.zero());
 
 	// result is negative
 	cpu.regPC = 0x0123;
 	cpu.regA = 0x20;
 	ram.bytes[0x1211] = 0x83;
-	cpu.nFlag = false;
-	cpu.zFlag = true;
+	cpu.setNegative(false);
+	cpu.setZero(true);
 	cpu.step();
-	BOOST_CHECK(cpu.nFlag);
-	BOOST_CHECK(!cpu.zFlag);
+	BOOST_CHECK(cpu.negative());
+	BOOST_CHECK(!cpu.zero());
 
 	// result is zero
 	cpu.regPC = 0x0123;
 	cpu.regA = 0x12;
 	ram.bytes[0x1211] = 0x12;
-	cpu.nFlag = false;
-	cpu.zFlag = true;
+	cpu.setNegative(false);
+	cpu.setZero(true);
 	cpu.step();
-	BOOST_CHECK(!cpu.nFlag);
-	BOOST_CHECK(cpu.zFlag);
+	BOOST_CHECK(!cpu.negative());
+	BOOST_CHECK(cpu.zero());
 
 	// Zero page variant. Flag setting is common, so just test the value.
 	ram.bytes[0x0123] = 0x45;		// EOR $nn
@@ -1304,29 +1308,29 @@ BOOST_AUTO_TEST_CASE(test_pla_instructions)
 	cpu.regSP = 0xEF;
 	cpu.regPC = 0x0123;
 	cpu.regA = 0xAB;
-	cpu.zFlag = true;
-	cpu.nFlag = false;
+	cpu.setZero(true);
+	cpu.setNegative(false);
 	ram.bytes[0x1F0] = 0xB3;
 	cpu.step();
 	BOOST_CHECK_EQUAL(cpu.regA, 0xB3);
 	BOOST_CHECK_EQUAL(cpu.regPC, 0x0124);
 	BOOST_CHECK_EQUAL(cpu.cycleCount, 4);
-	BOOST_CHECK(cpu.nFlag);
-	BOOST_CHECK(!cpu.zFlag);
+	BOOST_CHECK(cpu.negative());
+	BOOST_CHECK(!cpu.zero());
 
 	cpu.cycleCount = 0;
 	cpu.regSP = 0xEF;
 	cpu.regPC = 0x0123;
 	cpu.regA = 0xAB;
-	cpu.zFlag = false;
-	cpu.nFlag = true;
+	cpu.setZero(false);
+	cpu.setNegative(true);
 	ram.bytes[0x1F0] = 0x00;
 	cpu.step();
 	BOOST_CHECK_EQUAL(cpu.regA, 0x00);
 	BOOST_CHECK_EQUAL(cpu.regPC, 0x0124);
 	BOOST_CHECK_EQUAL(cpu.cycleCount, 4);
-	BOOST_CHECK(!cpu.nFlag);
-	BOOST_CHECK(cpu.zFlag);
+	BOOST_CHECK(!cpu.negative());
+	BOOST_CHECK(cpu.zero());
 }
 
 BOOST_AUTO_TEST_CASE(test_pha_instructions)
@@ -1379,12 +1383,12 @@ BOOST_AUTO_TEST_CASE(test_php_instructions)
 	cpu.regSP = 0xF0;
 	cpu.regPC = 0x0123;
 
-	cpu.nFlag = true;
-	cpu.zFlag = true;
-	cpu.vFlag = true;
-	cpu.cFlag = true;
-	cpu.decimalMode = true;
-	cpu.interruptDisable = true;
+	cpu.setNegative(true);
+	cpu.setZero(true);
+	cpu.setOverflow(true);
+	cpu.setCarry(true);
+	cpu.setDecimalMode(true);
+	cpu.setInterruptDisable(true);
 	cpu.step();
 	BOOST_CHECK_EQUAL(ram.bytes[0x1F0], 0xFF);
 	BOOST_CHECK_EQUAL(cpu.regSP, 0xEF);
@@ -1393,67 +1397,67 @@ BOOST_AUTO_TEST_CASE(test_php_instructions)
 
 	cpu.regSP = 0xF0;
 	cpu.regPC = 0x0123;
-	cpu.nFlag = false;
-	cpu.zFlag = true;
-	cpu.vFlag = true;
-	cpu.cFlag = true;
-	cpu.decimalMode = true;
-	cpu.interruptDisable = true;
+	cpu.setNegative(false);
+	cpu.setZero(true);
+	cpu.setOverflow(true);
+	cpu.setCarry(true);
+	cpu.setDecimalMode(true);
+	cpu.setInterruptDisable(true);
 	cpu.step();
 	BOOST_CHECK_EQUAL(ram.bytes[0x1F0], 0x7F);
 
 	cpu.regSP = 0xF0;
 	cpu.regPC = 0x0123;
-	cpu.nFlag = true;
-	cpu.zFlag = false;
-	cpu.vFlag = true;
-	cpu.cFlag = true;
-	cpu.decimalMode = true;
-	cpu.interruptDisable = true;
+	cpu.setNegative(true);
+	cpu.setZero(false);
+	cpu.setOverflow(true);
+	cpu.setCarry(true);
+	cpu.setDecimalMode(true);
+	cpu.setInterruptDisable(true);
 	cpu.step();
 	BOOST_CHECK_EQUAL(ram.bytes[0x1F0], 0xFD);
 
 	cpu.regSP = 0xF0;
 	cpu.regPC = 0x0123;
-	cpu.nFlag = true;
-	cpu.zFlag = true;
-	cpu.vFlag = false;
-	cpu.cFlag = true;
-	cpu.decimalMode = true;
-	cpu.interruptDisable = true;
+	cpu.setNegative(true);
+	cpu.setZero(true);
+	cpu.setOverflow(false);
+	cpu.setCarry(true);
+	cpu.setDecimalMode(true);
+	cpu.setInterruptDisable(true);
 	cpu.step();
 	BOOST_CHECK_EQUAL(ram.bytes[0x1F0], 0xBF);
 
 	cpu.regSP = 0xF0;
 	cpu.regPC = 0x0123;
-	cpu.nFlag = true;
-	cpu.zFlag = true;
-	cpu.vFlag = true;
-	cpu.cFlag = false;
-	cpu.decimalMode = true;
-	cpu.interruptDisable = true;
+	cpu.setNegative(true);
+	cpu.setZero(true);
+	cpu.setOverflow(true);
+	cpu.setCarry(false);
+	cpu.setDecimalMode(true);
+	cpu.setInterruptDisable(true);
 	cpu.step();
 	BOOST_CHECK_EQUAL(ram.bytes[0x1F0], 0xFE);
 
 	cpu.regSP = 0xF0;
 	cpu.regPC = 0x0123;
-	cpu.nFlag = true;
-	cpu.zFlag = true;
-	cpu.vFlag = true;
-	cpu.cFlag = true;
-	cpu.decimalMode = false;
-	cpu.interruptDisable = true;
+	cpu.setNegative(true);
+	cpu.setZero(true);
+	cpu.setOverflow(true);
+	cpu.setCarry(true);
+	cpu.setDecimalMode(false);
+	cpu.setInterruptDisable(true);
 	cpu.step();
 	BOOST_CHECK_EQUAL(ram.bytes[0x1F0], 0xF7);
 
 	cpu.regSP = 0xF0;
 	cpu.regPC = 0x0123;
-	cpu.nFlag = true;
-	cpu.zFlag = true;
-	cpu.vFlag = true;
-	cpu.cFlag = true;
-	cpu.decimalMode = true;
-	cpu.interruptDisable = false;
+	cpu.setNegative(true);
+	cpu.setZero(true);
+	cpu.setOverflow(true);
+	cpu.setCarry(true);
+	cpu.setDecimalMode(true);
+	cpu.setInterruptDisable(false);
 	cpu.step();
 	BOOST_CHECK_EQUAL(ram.bytes[0x1F0], 0xFB);
 }
@@ -1564,11 +1568,11 @@ BOOST_AUTO_TEST_CASE(test_clc_instructions)
 
 	cpu.cycleCount = 0;
 	cpu.regPC = 0x0123;
-	cpu.cFlag = true;
+	cpu.setCarry(true);
 	cpu.step();
 	BOOST_CHECK_EQUAL(cpu.regPC, 0x0124);
 	BOOST_CHECK_EQUAL(cpu.cycleCount, 2);
-	BOOST_CHECK_EQUAL(cpu.cFlag, false);
+	BOOST_CHECK_EQUAL(cpu.carry(), false);
 }
 
 BOOST_AUTO_TEST_CASE(test_sec_instructions)
@@ -1587,11 +1591,11 @@ BOOST_AUTO_TEST_CASE(test_sec_instructions)
 
 	cpu.cycleCount = 0;
 	cpu.regPC = 0x0123;
-	cpu.cFlag = false;
+	cpu.setCarry(false);
 	cpu.step();
 	BOOST_CHECK_EQUAL(cpu.regPC, 0x0124);
 	BOOST_CHECK_EQUAL(cpu.cycleCount, 2);
-	BOOST_CHECK_EQUAL(cpu.cFlag, true);
+	BOOST_CHECK_EQUAL(cpu.carry(), true);
 }
 
 BOOST_AUTO_TEST_CASE(test_jsr_rts_instructions)
@@ -1686,39 +1690,39 @@ BOOST_AUTO_TEST_CASE(test_bit_instructions)
 	cpu.cycleCount = 0;
 	cpu.regA = 0x11;
 	cpu.regPC = 0x0123;
-	cpu.nFlag = false;
-	cpu.zFlag = true;
-	cpu.vFlag = false;
+	cpu.setNegative(false);
+	cpu.setZero(true);
+	cpu.setOverflow(false);
 	cpu.step();
 	BOOST_CHECK_EQUAL(cpu.regPC, 0x0125);
 	BOOST_CHECK_EQUAL(cpu.cycleCount, 3);
-	BOOST_CHECK(cpu.nFlag);
-	BOOST_CHECK(!cpu.zFlag);
-	BOOST_CHECK(cpu.vFlag);
+	BOOST_CHECK(cpu.negative());
+	BOOST_CHECK(!cpu.zero());
+	BOOST_CHECK(cpu.overflow());
 
 	ram.bytes[0x10] = 0x43;
 	cpu.cycleCount = 0;
 	cpu.regA = 0x10;
 	cpu.regPC = 0x0123;
-	cpu.nFlag = true;
-	cpu.zFlag = false;
-	cpu.vFlag = false;
+	cpu.setNegative(true);
+	cpu.setZero(false);
+	cpu.setOverflow(false);
 	cpu.step();
-	BOOST_CHECK(!cpu.nFlag);
-	BOOST_CHECK(cpu.zFlag);
-	BOOST_CHECK(cpu.vFlag);
+	BOOST_CHECK(!cpu.negative());
+	BOOST_CHECK(cpu.zero());
+	BOOST_CHECK(cpu.overflow());
 
 	ram.bytes[0x10] = 0x23;
 	cpu.cycleCount = 0;
 	cpu.regA = 0x10;
 	cpu.regPC = 0x0123;
-	cpu.nFlag = true;
-	cpu.zFlag = false;
-	cpu.vFlag = true;
+	cpu.setNegative(true);
+	cpu.setZero(false);
+	cpu.setOverflow(true);
 	cpu.step();
-	BOOST_CHECK(!cpu.nFlag);
-	BOOST_CHECK(cpu.zFlag);
-	BOOST_CHECK(!cpu.vFlag);
+	BOOST_CHECK(!cpu.negative());
+	BOOST_CHECK(cpu.zero());
+	BOOST_CHECK(!cpu.overflow());
 }
 
 BOOST_AUTO_TEST_CASE(test_branch_instructions)
@@ -1742,14 +1746,14 @@ BOOST_AUTO_TEST_CASE(test_branch_instructions)
 
 	cpu.cycleCount = 0;
 	cpu.regPC = 0x0123;
-	cpu.nFlag = true;
+	cpu.setNegative(true);
 	cpu.step();
 	BOOST_CHECK_EQUAL(cpu.regPC, 0x125);
 	BOOST_CHECK_EQUAL(cpu.cycleCount, 2);
 
 	cpu.cycleCount = 0;
 	cpu.regPC = 0x0123;
-	cpu.nFlag = false;
+	cpu.setNegative(false);
 	cpu.step();
 	BOOST_CHECK_EQUAL(cpu.regPC, 0x121);
 	BOOST_CHECK_EQUAL(cpu.cycleCount, 3);
@@ -1757,7 +1761,7 @@ BOOST_AUTO_TEST_CASE(test_branch_instructions)
 	cpu.cycleCount = 0;
 	cpu.regPC = 0x0123;
 	ram.bytes[0x0124] = -0x30;
-	cpu.nFlag = false;
+	cpu.setNegative(false);
 	cpu.step();
 	BOOST_CHECK_EQUAL(cpu.regPC, 0x0F5);
 	BOOST_CHECK_EQUAL(cpu.cycleCount, 4);
@@ -1770,14 +1774,14 @@ BOOST_AUTO_TEST_CASE(test_branch_instructions)
 
 	cpu.cycleCount = 0;
 	cpu.regPC = 0x0123;
-	cpu.nFlag = false;
+	cpu.setNegative(false);
 	cpu.step();
 	BOOST_CHECK_EQUAL(cpu.regPC, 0x125);
 	BOOST_CHECK_EQUAL(cpu.cycleCount, 2);
 
 	cpu.cycleCount = 0;
 	cpu.regPC = 0x0123;
-	cpu.nFlag = true;
+	cpu.setNegative(true);
 	cpu.step();
 	BOOST_CHECK_EQUAL(cpu.regPC, 0x121);
 	BOOST_CHECK_EQUAL(cpu.cycleCount, 3);
@@ -1790,14 +1794,14 @@ BOOST_AUTO_TEST_CASE(test_branch_instructions)
 
 	cpu.cycleCount = 0;
 	cpu.regPC = 0x0123;
-	cpu.vFlag = true;
+	cpu.setOverflow(true);
 	cpu.step();
 	BOOST_CHECK_EQUAL(cpu.regPC, 0x125);
 	BOOST_CHECK_EQUAL(cpu.cycleCount, 2);
 
 	cpu.cycleCount = 0;
 	cpu.regPC = 0x0123;
-	cpu.vFlag = false;
+	cpu.setOverflow(false);
 	cpu.step();
 	BOOST_CHECK_EQUAL(cpu.regPC, 0x121);
 	BOOST_CHECK_EQUAL(cpu.cycleCount, 3);
@@ -1810,14 +1814,14 @@ BOOST_AUTO_TEST_CASE(test_branch_instructions)
 
 	cpu.cycleCount = 0;
 	cpu.regPC = 0x0123;
-	cpu.zFlag = true;
+	cpu.setZero(true);
 	cpu.step();
 	BOOST_CHECK_EQUAL(cpu.regPC, 0x125);
 	BOOST_CHECK_EQUAL(cpu.cycleCount, 2);
 
 	cpu.cycleCount = 0;
 	cpu.regPC = 0x0123;
-	cpu.zFlag = false;
+	cpu.setZero(false);
 	cpu.step();
 	BOOST_CHECK_EQUAL(cpu.regPC, 0x121);
 	BOOST_CHECK_EQUAL(cpu.cycleCount, 3);
@@ -1830,14 +1834,14 @@ BOOST_AUTO_TEST_CASE(test_branch_instructions)
 
 	cpu.cycleCount = 0;
 	cpu.regPC = 0x0123;
-	cpu.zFlag = false;
+	cpu.setZero(false);
 	cpu.step();
 	BOOST_CHECK_EQUAL(cpu.regPC, 0x125);
 	BOOST_CHECK_EQUAL(cpu.cycleCount, 2);
 
 	cpu.cycleCount = 0;
 	cpu.regPC = 0x0123;
-	cpu.zFlag = true;
+	cpu.setZero(true);
 	cpu.step();
 	BOOST_CHECK_EQUAL(cpu.regPC, 0x121);
 	BOOST_CHECK_EQUAL(cpu.cycleCount, 3);
@@ -1850,14 +1854,14 @@ BOOST_AUTO_TEST_CASE(test_branch_instructions)
 
 	cpu.cycleCount = 0;
 	cpu.regPC = 0x0123;
-	cpu.cFlag = false;
+	cpu.setCarry(false);
 	cpu.step();
 	BOOST_CHECK_EQUAL(cpu.regPC, 0x125);
 	BOOST_CHECK_EQUAL(cpu.cycleCount, 2);
 
 	cpu.cycleCount = 0;
 	cpu.regPC = 0x0123;
-	cpu.cFlag = true;
+	cpu.setCarry(true);
 	cpu.step();
 	BOOST_CHECK_EQUAL(cpu.regPC, 0x121);
 	BOOST_CHECK_EQUAL(cpu.cycleCount, 3);
@@ -1870,15 +1874,850 @@ BOOST_AUTO_TEST_CASE(test_branch_instructions)
 
 	cpu.cycleCount = 0;
 	cpu.regPC = 0x0123;
-	cpu.cFlag = true;
+	cpu.setCarry(true);
 	cpu.step();
 	BOOST_CHECK_EQUAL(cpu.regPC, 0x125);
 	BOOST_CHECK_EQUAL(cpu.cycleCount, 2);
 
 	cpu.cycleCount = 0;
 	cpu.regPC = 0x0123;
-	cpu.cFlag = false;
+	cpu.setCarry(false);
 	cpu.step();
 	BOOST_CHECK_EQUAL(cpu.regPC, 0x121);
 	BOOST_CHECK_EQUAL(cpu.cycleCount, 3);
 }
+
+BOOST_AUTO_TEST_CASE(test_code_cache)
+{
+	Ram ram(64 * 1024);
+	DirectAddressBus bus(ram);
+
+	for (int i = 0; i < 0xFFFF; ++i) {
+		ram.bytes[i] = 0;
+	}
+
+	m6502 cpu(bus);
+	cpu.reset();
+	cpu.enableCodeCache(0x0200, 0x02FF);
+
+	// The STA patches the operand of the LDA that follows it.
+	ram.bytes[0x0200] = 0xA9;		// LDA #$05
+	ram.bytes[0x0201] = 0x05;
+	ram.bytes[0x0202] = 0x8D;		// STA $0206
+	ram.bytes[0x0203] = 0x06;
+	ram.bytes[0x0204] = 0x02;
+	ram.bytes[0x0205] = 0xA9;		// LDA #$00
+	ram.bytes[0x0206] = 0x00;
+	ram.bytes[0x0207] = 0xAA;		// TAX
+	ram.bytes[0x0208] = 0x4C;		// JMP $0200
+	ram.bytes[0x0209] = 0x00;
+	ram.bytes[0x020A] = 0x02;
+
+	cpu.cycleCount = 0;
+	cpu.regPC = 0x0200;
+	for (int i = 0; i < 5; ++i) {
+		cpu.step();
+	}
+	BOOST_CHECK_EQUAL(cpu.regPC, 0x0200);
+	BOOST_CHECK_EQUAL(cpu.regX, 0x05);
+	BOOST_CHECK_EQUAL(cpu.cycleCount, 2 + 4 + 2 + 2 + 3);
+
+	// Run the block again from the cache, then change it behind the cpu's back.
+	for (int i = 0; i < 5; ++i) {
+		cpu.step();
+	}
+	BOOST_CHECK_EQUAL(cpu.regX, 0x05);
+
+	ram.bytes[0x0201] = 0x07;
+	cpu.invalidateCodeCache(0x0201);
+	for (int i = 0; i < 5; ++i) {
+		cpu.step();
+	}
+	BOOST_CHECK_EQUAL(cpu.regX, 0x07);
+}
+
+BOOST_AUTO_TEST_CASE(test_code_cache_run)
+{
+	Ram ram(64 * 1024);
+	DirectAddressBus bus(ram);
+
+	for (int i = 0; i < 0xFFFF; ++i) {
+		ram.bytes[i] = 0;
+	}
+
+	m6502 cpu(bus);
+	cpu.reset();
+	cpu.enableCodeCache(0x0200, 0x02FF);
+
+	// Each pass stores X into the operand of the LDY that follows, freeing the block
+	// the STA was fetched from while it is still executing.
+	ram.bytes[0x0200] = 0xE8;		// INX
+	ram.bytes[0x0201] = 0x8A;		// TXA
+	ram.bytes[0x0202] = 0x8D;		// STA $0206
+	ram.bytes[0x0203] = 0x06;
+	ram.bytes[0x0204] = 0x02;
+	ram.bytes[0x0205] = 0xA0;		// LDY #$00
+	ram.bytes[0x0206] = 0x00;
+	ram.bytes[0x0207] = 0x4C;		// JMP $0200
+	ram.bytes[0x0208] = 0x00;
+	ram.bytes[0x0209] = 0x02;
+
+	// Each pass round the loop takes 13 cycles.
+	cpu.cycleCount = 0;
+	cpu.regPC = 0x0200;
+	cpu.regX = 0;
+	BOOST_CHECK_EQUAL(cpu.run(13 * 4), 0);
+	BOOST_CHECK_EQUAL(cpu.regPC, 0x0200);
+	BOOST_CHECK_EQUAL(cpu.regX, 4);
+	BOOST_CHECK_EQUAL(cpu.regY, 4);
+	BOOST_CHECK_EQUAL(cpu.cycleCount, 13 * 4);
+
+	BOOST_CHECK_EQUAL(cpu.run(8), 0);
+	BOOST_CHECK_EQUAL(cpu.regPC, 0x0205);
+	BOOST_CHECK_EQUAL(cpu.regY, 4);
+	BOOST_CHECK_EQUAL(cpu.run(5), 0);
+	BOOST_CHECK_EQUAL(cpu.regY, 5);
+}
+
+BOOST_AUTO_TEST_CASE(test_run)
+{
+	Ram ram(64 * 1024);
+	DirectAddressBus bus(ram);
+
+	for (int i = 0; i < 0xFFFF; ++i) {
+		ram.bytes[i] = 0;
+	}
+
+	m6502 cpu(bus);
+	cpu.reset();
+
+	ram.bytes[0x0200] = 0xE8;		// INX
+	ram.bytes[0x0201] = 0x4C;		// JMP $0200
+	ram.bytes[0x0202] = 0x00;
+	ram.bytes[0x0203] = 0x02;
+
+	// Each pass round the loop takes 5 cycles.
+	cpu.cycleCount = 0;
+	cpu.regPC = 0x0200;
+	cpu.regX = 0;
+	BOOST_CHECK_EQUAL(cpu.run(20), 0);
+	BOOST_CHECK_EQUAL(cpu.cycleCount, 20);
+	BOOST_CHECK_EQUAL(cpu.regX, 4);
+
+	BOOST_CHECK_EQUAL(cpu.run(6), 1);
+	BOOST_CHECK_EQUAL(cpu.cycleCount, 27);
+	BOOST_CHECK_EQUAL(cpu.regPC, 0x0201);
+	BOOST_CHECK_EQUAL(cpu.regX, 6);
+
+	// An unknown opcode stops the run short, here after the JMP.
+	ram.bytes[0x0200] = 0x02;
+	BOOST_CHECK_EQUAL(cpu.run(10), -7);
+	BOOST_CHECK_EQUAL(cpu.regPC, 0x0200);
+}
+
+// The block tests loop enough times for the JIT to compile the loop body, so with
+// M6502_JIT on the later passes go through compiled code.
+BOOST_AUTO_TEST_CASE(test_block_registers)
+{
+	Ram ram(64 * 1024);
+	DirectAddressBus bus(ram);
+
+	for (int i = 0; i < 0xFFFF; ++i) {
+		ram.bytes[i] = 0;
+	}
+
+	m6502 cpu(bus);
+	cpu.reset();
+	cpu.enableCodeCache(0x0200, 0x02FF);
+
+	ram.bytes[0x0200] = 0xE8;		// INX
+	ram.bytes[0x0201] = 0xC8;		// INY
+	ram.bytes[0x0202] = 0xC8;		// INY
+	ram.bytes[0x0203] = 0x8A;		// TXA
+	ram.bytes[0x0204] = 0x4C;		// JMP $0200
+	ram.bytes[0x0205] = 0x00;
+	ram.bytes[0x0206] = 0x02;
+
+	// Each pass round the loop takes 11 cycles.
+	cpu.cycleCount = 0;
+	cpu.regPC = 0x0200;
+	cpu.regA = cpu.regX = cpu.regY = 0;
+	BOOST_CHECK_EQUAL(cpu.run(11 * 10), 0);
+	BOOST_CHECK_EQUAL(cpu.cycleCount, 11 * 10);
+	BOOST_CHECK_EQUAL(cpu.regPC, 0x0200);
+	BOOST_CHECK_EQUAL(cpu.regA, 10);
+	BOOST_CHECK_EQUAL(cpu.regX, 10);
+	BOOST_CHECK_EQUAL(cpu.regY, 20);
+
+	// A register changed between runs is picked up by the next block.
+	cpu.regX = 0x7F;
+	BOOST_CHECK_EQUAL(cpu.run(11), 0);
+	BOOST_CHECK_EQUAL(cpu.regA, 0x80);
+	BOOST_CHECK_EQUAL(cpu.regY, 22);
+	BOOST_CHECK(cpu.getP() & 0x80);
+}
+
+BOOST_AUTO_TEST_CASE(test_block_branches)
+{
+	Ram ram(64 * 1024);
+	DirectAddressBus bus(ram);
+
+	for (int i = 0; i < 0xFFFF; ++i) {
+		ram.bytes[i] = 0;
+	}
+
+	m6502 cpu(bus);
+	cpu.reset();
+	cpu.enableCodeCache(0x0200, 0x02FF);
+
+	ram.bytes[0x0200] = 0xCA;		// DEX
+	ram.bytes[0x0201] = 0xD0;		// BNE $0200
+	ram.bytes[0x0202] = 0xFD;
+	ram.bytes[0x0203] = 0xA0;		// LDY #$42
+	ram.bytes[0x0204] = 0x42;
+
+	// Nine taken branches at 5 cycles, then one not taken at 4.
+	cpu.cycleCount = 0;
+	cpu.regPC = 0x0200;
+	cpu.regX = 10;
+	cpu.regY = 0;
+	BOOST_CHECK_EQUAL(cpu.run(9 * 5 + 4 + 2), 0);
+	BOOST_CHECK_EQUAL(cpu.cycleCount, 9 * 5 + 4 + 2);
+	BOOST_CHECK_EQUAL(cpu.regPC, 0x0205);
+	BOOST_CHECK_EQUAL(cpu.regX, 0);
+	BOOST_CHECK_EQUAL(cpu.regY, 0x42);
+
+	// Not taken straight away.
+	cpu.regPC = 0x0200;
+	cpu.regX = 1;
+	BOOST_CHECK_EQUAL(cpu.run(4), 0);
+	BOOST_CHECK_EQUAL(cpu.regPC, 0x0203);
+	BOOST_CHECK_EQUAL(cpu.cycleCount, 9 * 5 + 4 + 2 + 4);
+
+	// Taken once, then stopped at the budget.
+	cpu.regPC = 0x0200;
+	cpu.regX = 3;
+	BOOST_CHECK_EQUAL(cpu.run(5), 0);
+	BOOST_CHECK_EQUAL(cpu.regPC, 0x0200);
+	BOOST_CHECK_EQUAL(cpu.regX, 2);
+	BOOST_CHECK_EQUAL(cpu.cycleCount, 9 * 5 + 4 + 2 + 4 + 5);
+}
+
+BOOST_AUTO_TEST_CASE(test_block_handler_cycles)
+{
+	Ram ram(64 * 1024);
+	DirectAddressBus bus(ram);
+	m6502 cpu(bus);
+	cpu.reset();
+	cpu.enableCodeCache(0x0200, 0x02FF);
+
+	std::vector<std::int64_t> writeTimes;
+	bus.addWriteHandler(0x0300, [&cpu, &writeTimes](std::uint32_t, std::uint8_t) { writeTimes.push_back(cpu.cycleCount); });
+
+	ram.bytes[0x0200] = 0xE8;		// INX
+	ram.bytes[0x0201] = 0x99;		// STA $0300, Y
+	ram.bytes[0x0202] = 0x00;
+	ram.bytes[0x0203] = 0x03;
+	ram.bytes[0x0204] = 0x4C;		// JMP $0200
+	ram.bytes[0x0205] = 0x00;
+	ram.bytes[0x0206] = 0x02;
+
+	// The write handler sees the cycles up to and including the STA on every pass,
+	// compiled or not.
+	cpu.cycleCount = 0;
+	cpu.regPC = 0x0200;
+	cpu.regY = 0;
+	BOOST_CHECK_EQUAL(cpu.run(10 * 10), 0);
+	BOOST_CHECK_EQUAL(cpu.cycleCount, 10 * 10);
+	BOOST_REQUIRE_EQUAL(writeTimes.size(), 10U);
+	for (std::size_t i = 0; i < writeTimes.size(); ++i) {
+		BOOST_CHECK_EQUAL(writeTimes[i], static_cast<std::int64_t>(i * 10 + 7));
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_block_self_write)
+{
+	Ram ram(64 * 1024);
+	DirectAddressBus bus(ram);
+
+	for (int i = 0; i < 0xFFFF; ++i) {
+		ram.bytes[i] = 0;
+	}
+
+	m6502 cpu(bus);
+	cpu.reset();
+	cpu.enableCodeCache(0x0200, 0x02FF);
+
+	// The store stays in page 1 for the first five passes, then lands in the loop's
+	// own page, which leaves the block straight after the STA.
+	ram.bytes[0x0280] = 0xC8;		// INY
+	ram.bytes[0x0281] = 0x98;		// TYA
+	ram.bytes[0x0282] = 0x99;		// STA $01FA, Y
+	ram.bytes[0x0283] = 0xFA;
+	ram.bytes[0x0284] = 0x01;
+	ram.bytes[0x0285] = 0xE8;		// INX
+	ram.bytes[0x0286] = 0x4C;		// JMP $0280
+	ram.bytes[0x0287] = 0x80;
+	ram.bytes[0x0288] = 0x02;
+
+	// Each pass round the loop takes 14 cycles.
+	cpu.cycleCount = 0;
+	cpu.regPC = 0x0280;
+	cpu.regA = cpu.regX = cpu.regY = 0;
+	BOOST_CHECK_EQUAL(cpu.run(14 * 8), 0);
+	BOOST_CHECK_EQUAL(cpu.cycleCount, 14 * 8);
+	BOOST_CHECK_EQUAL(cpu.regPC, 0x0280);
+	BOOST_CHECK_EQUAL(cpu.regX, 8);
+	BOOST_CHECK_EQUAL(cpu.regY, 8);
+	BOOST_CHECK_EQUAL(ram.bytes[0x01FB], 1);
+	BOOST_CHECK_EQUAL(ram.bytes[0x01FF], 5);
+	BOOST_CHECK_EQUAL(ram.bytes[0x0200], 6);
+	BOOST_CHECK_EQUAL(ram.bytes[0x0202], 8);
+
+	// Stopping just after the first write into the page.
+	cpu.regPC = 0x0280;
+	cpu.regY = 0;
+	cpu.regX = 0;
+	ram.bytes[0x0200] = 0;
+	BOOST_CHECK_EQUAL(cpu.run(14 * 5), 0);
+	BOOST_CHECK_EQUAL(cpu.run(9), 0);
+	BOOST_CHECK_EQUAL(cpu.regPC, 0x0285);
+	BOOST_CHECK_EQUAL(cpu.regX, 5);
+	BOOST_CHECK_EQUAL(ram.bytes[0x0200], 6);
+}
+
+BOOST_AUTO_TEST_CASE(test_direct_bus_core)
+{
+	Ram ram(64 * 1024);
+	DirectAddressBus bus(ram);
+
+	for (int i = 0; i < 0xFFFF; ++i) {
+		ram.bytes[i] = 0;
+	}
+
+	int handlerWrites = 0;
+	bus.addWriteHandler(0x5100, [&](std::uint32_t, std::uint8_t val) { handlerWrites += val; });
+	bus.setMirror(0xFF00, 0xFFFF, 0x3F00);
+	ram.bytes[0x3FFC] = 0x00;		// reset vector, read through the mirror
+	ram.bytes[0x3FFD] = 0x02;
+
+	ram.bytes[0x0200] = 0xA9;		// LDA #$21
+	ram.bytes[0x0201] = 0x21;
+	ram.bytes[0x0202] = 0x8D;		// STA $5100
+	ram.bytes[0x0203] = 0x00;
+	ram.bytes[0x0204] = 0x51;
+	ram.bytes[0x0205] = 0x85;		// STA $10
+	ram.bytes[0x0206] = 0x10;
+
+	m6502Core<DirectAddressBus> cpu(bus);
+	cpu.reset();
+	BOOST_CHECK_EQUAL(cpu.regPC, 0x0200);
+	BOOST_CHECK_EQUAL(cpu.run(9), 0);
+	BOOST_CHECK_EQUAL(handlerWrites, 0x21);
+	BOOST_CHECK_EQUAL(ram.bytes[0x5100], 0);
+	BOOST_CHECK_EQUAL(ram.bytes[0x0010], 0x21);
+}
+
+BOOST_AUTO_TEST_CASE(test_status_register)
+{
+	Ram ram(64 * 1024);
+	DirectAddressBus bus(ram);
+
+	m6502 cpu(bus);
+	cpu.reset();
+
+	cpu.setP(0xC3);
+	BOOST_CHECK_EQUAL(cpu.negative(), true);
+	BOOST_CHECK_EQUAL(cpu.overflow(), true);
+	BOOST_CHECK_EQUAL(cpu.decimalMode(), false);
+	BOOST_CHECK_EQUAL(cpu.interruptDisable(), false);
+	BOOST_CHECK_EQUAL(cpu.zero(), true);
+	BOOST_CHECK_EQUAL(cpu.carry(), true);
+	BOOST_CHECK_EQUAL(cpu.getP(), 0xF3);
+
+	cpu.setCarry(false);
+	cpu.setDecimalMode(true);
+	BOOST_CHECK_EQUAL(cpu.getP(), 0xFA);
+
+	// The state can be snapshotted and restored with a plain copy.
+	cpu.regA = 0x12;
+	cpu.cycleCount = 1234;
+	m6502State snapshot = cpu;
+	cpu.regA = 0;
+	cpu.setP(0);
+	static_cast<m6502State&>(cpu) = snapshot;
+	BOOST_CHECK_EQUAL(cpu.regA, 0x12);
+	BOOST_CHECK_EQUAL(cpu.cycleCount, 1234);
+	BOOST_CHECK_EQUAL(cpu.getP(), 0xFA);
+}
+
+// Digit by digit decimal arithmetic for checking the cpu's decimal mode tables. Flags are
+// returned in their P register positions.
+static void referenceDecimalADC(int a, int b, int carry, int& result, int& flags)
+{
+	int lo = (a & 0x0F) + (b & 0x0F) + carry;
+	if (lo > 9) {
+		lo += 6;
+	}
+	int hi = (a >> 4) + (b >> 4) + (lo > 0x0F ? 1 : 0);
+	int intermediate = ((hi << 4) | (lo & 0x0F)) & 0xFF;
+
+	flags = intermediate & 0x80;
+	if ((~(a ^ b) & (a ^ intermediate) & 0x80) != 0) {
+		flags |= 0x40;
+	}
+	if (((a + b + carry) & 0xFF) == 0) {
+		flags |= 0x02;
+	}
+	if (hi > 9) {
+		hi += 6;
+	}
+	if (hi > 0x0F) {
+		flags |= 0x01;
+	}
+	result = ((hi << 4) | (lo & 0x0F)) & 0xFF;
+}
+
+static void referenceDecimalSBC(int a, int b, int carry, int& result, int& flags)
+{
+	// The flags are the same as in binary mode.
+	int binary = a - b - (1 - carry);
+	flags = binary & 0x80;
+	if (((a ^ b) & (a ^ binary) & 0x80) != 0) {
+		flags |= 0x40;
+	}
+	if ((binary & 0xFF) == 0) {
+		flags |= 0x02;
+	}
+	if (binary >= 0) {
+		flags |= 0x01;
+	}
+
+	int lo = (a & 0x0F) - (b & 0x0F) - (1 - carry);
+	int hi = (a >> 4) - (b >> 4);
+	if (lo < 0) {
+		lo -= 6;
+		hi -= 1;
+	}
+	if (hi < 0) {
+		hi -= 6;
+	}
+	result = ((hi << 4) | (lo & 0x0F)) & 0xFF;
+}
+
+BOOST_AUTO_TEST_CASE(test_decimal_mode_exhaustive)
+{
+	Ram ram(64 * 1024);
+	DirectAddressBus bus(ram);
+
+	m6502 cpu(bus);
+	cpu.reset();
+
+	for (int opcode : { 0x69, 0xE9 }) {
+		int mismatches = 0;
+		for (int carry = 0; carry < 2; ++carry) {
+			for (int a = 0; a < 256; ++a) {
+				for (int b = 0; b < 256; ++b) {
+					ram.bytes[0x0200] = opcode;		// ADC #nn or SBC #nn
+					ram.bytes[0x0201] = b;
+					cpu.regPC = 0x0200;
+					cpu.regA = a;
+					cpu.setP(0x08 | carry);
+					cpu.step();
+
+					int result;
+					int flags;
+					if (opcode == 0x69) {
+						referenceDecimalADC(a, b, carry, result, flags);
+					}
+					else {
+						referenceDecimalSBC(a, b, carry, result, flags);
+					}
+					if (cpu.regA != result || (cpu.getP() & 0xC3) != flags) {
+						if (mismatches == 0) {
+							BOOST_TEST_MESSAGE("opcode " << opcode << " a " << a << " b " << b << " carry " << carry);
+						}
+						++mismatches;
+					}
+				}
+			}
+		}
+		BOOST_CHECK_EQUAL(mismatches, 0);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_idle_loop)
+{
+	Ram ram(64 * 1024);
+	DirectAddressBus bus(ram);
+
+	for (int i = 0; i < 0xFFFF; ++i) {
+		ram.bytes[i] = 0;
+	}
+
+	// Waits for $10 to become non zero, then counts in X. The branch back crosses a page.
+	ram.bytes[0x02FD] = 0xA5;		// LDA $10
+	ram.bytes[0x02FE] = 0x10;
+	ram.bytes[0x02FF] = 0xF0;		// BEQ $02FD
+	ram.bytes[0x0300] = 0xFC;
+	ram.bytes[0x0301] = 0xE8;		// INX
+	ram.bytes[0x0302] = 0x4C;		// JMP $0301
+	ram.bytes[0x0303] = 0x01;
+	ram.bytes[0x0304] = 0x03;
+
+	// The same budgets stepped one instruction at a time and run with skipping.
+	m6502 stepped(bus);
+	m6502 skipped(bus);
+	for (m6502* cpu : { &stepped, &skipped }) {
+		cpu->reset();
+		cpu->enableCodeCache(0x0200, 0x03FF);
+		cpu->regPC = 0x02FD;
+		cpu->regX = 0;
+		cpu->cycleCount = 0;
+		cpu->setP(0x00);
+	}
+
+	const int budgets[] = { 1000, 7, 100003, 3 };
+	std::int64_t target = 0;
+	for (int budget : budgets) {
+		target += budget;
+		while (stepped.cycleCount < target) {
+			stepped.step();
+		}
+		skipped.run(static_cast<int>(target - skipped.cycleCount));
+
+		BOOST_CHECK_EQUAL(skipped.cycleCount, stepped.cycleCount);
+		BOOST_CHECK_EQUAL(skipped.regPC, stepped.regPC);
+		BOOST_CHECK_EQUAL(skipped.regA, stepped.regA);
+		BOOST_CHECK_EQUAL(skipped.getP(), stepped.getP());
+	}
+	BOOST_CHECK_EQUAL(skipped.regX, 0);
+
+	// Changing the polled value between runs ends the loop.
+	ram.bytes[0x10] = 1;
+	target += 100;
+	while (stepped.cycleCount < target) {
+		stepped.step();
+	}
+	skipped.run(static_cast<int>(target - skipped.cycleCount));
+	BOOST_CHECK_EQUAL(skipped.cycleCount, stepped.cycleCount);
+	BOOST_CHECK_EQUAL(skipped.regX, stepped.regX);
+	BOOST_CHECK(skipped.regX != 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_idle_loop_late_handler)
+{
+	Ram ram(64 * 1024);
+	DirectAddressBus bus(ram);
+
+	for (int i = 0; i < 0xFFFF; ++i) {
+		ram.bytes[i] = 0;
+	}
+
+	ram.bytes[0x0200] = 0xAD;		// LDA $5101
+	ram.bytes[0x0201] = 0x01;
+	ram.bytes[0x0202] = 0x51;
+	ram.bytes[0x0203] = 0x10;		// BPL $0200
+	ram.bytes[0x0204] = 0xFB;
+	ram.bytes[0x0205] = 0xE8;		// INX
+
+	m6502 cpu(bus);
+	cpu.reset();
+	cpu.enableCodeCache(0x0200, 0x02FF);
+	cpu.regPC = 0x0200;
+	cpu.regX = 0;
+	cpu.cycleCount = 0;
+
+	// Polling plain memory, so the loop is decoded as idle and skipped.
+	cpu.run(70);
+	BOOST_CHECK_EQUAL(cpu.regPC, 0x0200);
+
+	// The port turns up after the loop was decoded and must now be read every pass.
+	int reads = 0;
+	bus.addReadHandler(0x5101, [&](std::uint32_t) { ++reads; return static_cast<std::uint8_t>(reads >= 10 ? 0x80 : 0); });
+	cpu.run(100);
+	BOOST_CHECK_EQUAL(reads, 10);
+	BOOST_CHECK_EQUAL(cpu.regX, 1);
+}
+
+// Passes everything to a DirectAddressBus and counts the reads of one address, which
+// the cpu still sees as plain memory.
+class ReadCountingBus : public AddressBus
+{
+public:
+	ReadCountingBus(DirectAddressBus& busIn, std::uint32_t countedIn) : bus(busIn), counted(countedIn) {}
+
+	std::uint8_t readByte(std::uint32_t address) override
+	{
+		if (address == counted) {
+			++reads;
+		}
+		return bus.readByte(address);
+	}
+	void writeByte(std::uint32_t address, std::uint8_t val) override { bus.writeByte(address, val); }
+	void setByte(std::uint32_t address, std::uint8_t val) override { bus.setByte(address, val); }
+	bool hasReadHandler(std::uint32_t address) const override { return bus.hasReadHandler(address); }
+
+	int reads = 0;
+
+private:
+	DirectAddressBus& bus;
+	std::uint32_t counted;
+};
+
+BOOST_AUTO_TEST_CASE(test_idle_loop_scheduled_latch)
+{
+	Ram ram(64 * 1024);
+	DirectAddressBus directBus(ram);
+	ReadCountingBus bus(directBus, 0x5103);
+
+	// As on sidetrac, the input port next to the latch has a read handler and the latch
+	// is memory that scheduled events write.
+	directBus.addReadHandler(0x5101, [](std::uint32_t) { return static_cast<std::uint8_t>(0xFF); });
+
+	ram.bytes[0x0200] = 0xAD;		// LDA $5103
+	ram.bytes[0x0201] = 0x03;
+	ram.bytes[0x0202] = 0x51;
+	ram.bytes[0x0203] = 0xF0;		// BEQ $0200
+	ram.bytes[0x0204] = 0xFB;
+	ram.bytes[0x0205] = 0xE8;		// INX
+	ram.bytes[0x0206] = 0x4C;		// JMP $0206
+	ram.bytes[0x0207] = 0x06;
+	ram.bytes[0x0208] = 0x02;
+
+	m6502 cpu(bus);
+	cpu.reset();
+	cpu.enableCodeCache(0x0200, 0x02FF);
+	cpu.regPC = 0x0200;
+	cpu.regX = 0;
+	cpu.cycleCount = 0;
+
+	Scheduler scheduler;
+	scheduler.schedule(70000, [&](std::int64_t) { bus.setByte(0x5103, 0x04); });
+
+	// The 10000 passes before the latch is set are skipped rather than read, and the
+	// loop still sees the latch as soon as it is set.
+	BOOST_CHECK(cpu.runUntil(scheduler, 70100));
+	BOOST_CHECK(bus.reads < 10);
+	BOOST_CHECK_EQUAL(cpu.regX, 1);
+	BOOST_CHECK_EQUAL(cpu.regPC, 0x0206);
+}
+
+BOOST_AUTO_TEST_CASE(test_scheduled_irq)
+{
+	Ram ram(64 * 1024);
+	DirectAddressBus bus(ram);
+
+	for (int i = 0; i < 0xFFFF; ++i) {
+		ram.bytes[i] = 0;
+	}
+	ram.bytes[0xFFFE] = 0x00;
+	ram.bytes[0xFFFF] = 0x03;
+
+	ram.bytes[0x0200] = 0xE8;		// INX
+	ram.bytes[0x0201] = 0x4C;		// JMP $0200
+	ram.bytes[0x0202] = 0x00;
+	ram.bytes[0x0203] = 0x02;
+
+	ram.bytes[0x0300] = 0xC8;		// INY
+	ram.bytes[0x0301] = 0x40;		// RTI
+
+	m6502 cpu(bus);
+	cpu.reset();
+	cpu.cycleCount = 0;
+	cpu.regPC = 0x0200;
+	cpu.regSP = 0xFF;
+	cpu.regX = 0;
+	cpu.regY = 0;
+	cpu.setP(0x00);
+
+	// The line is low for cycles 12 to 13, so the irq is taken after the INX that ends
+	// on cycle 12 and entering it takes 7 cycles.
+	Scheduler scheduler;
+	scheduler.schedule(12, [&](std::int64_t) { cpu.setIrqLow(); });
+	scheduler.schedule(13, [&](std::int64_t) { cpu.setIrqHigh(); });
+
+	BOOST_CHECK(cpu.runUntil(scheduler, 19));
+	BOOST_CHECK_EQUAL(cpu.cycleCount, 19);
+	BOOST_CHECK_EQUAL(cpu.regPC, 0x0300);
+	BOOST_CHECK_EQUAL(cpu.regX, 3);
+	BOOST_CHECK_EQUAL(cpu.regSP, 0xFC);
+	BOOST_CHECK_EQUAL(ram.bytes[0x01FF], 0x02);
+	BOOST_CHECK_EQUAL(ram.bytes[0x01FE], 0x01);
+	BOOST_CHECK(cpu.interruptDisable());
+
+	BOOST_CHECK(cpu.runUntil(scheduler, 40));
+	BOOST_CHECK_EQUAL(cpu.cycleCount, 40);
+	BOOST_CHECK_EQUAL(cpu.regPC, 0x0200);
+	BOOST_CHECK_EQUAL(cpu.regX, 5);
+	BOOST_CHECK_EQUAL(cpu.regY, 1);
+	BOOST_CHECK_EQUAL(cpu.regSP, 0xFF);
+	BOOST_CHECK(!cpu.interruptDisable());
+
+	// CLI lets a pending irq in after the instruction following it. The step that enters
+	// the irq also runs the first instruction of the handler.
+	ram.bytes[0x0204] = 0x58;		// CLI
+	ram.bytes[0x0205] = 0xE8;		// INX
+	cpu.regPC = 0x0204;
+	cpu.setInterruptDisable(true);
+	cpu.setIrqLow();
+	cpu.step();
+	BOOST_CHECK_EQUAL(cpu.cycleCount, 42);
+	BOOST_CHECK_EQUAL(cpu.regPC, 0x0205);
+	cpu.step();
+	BOOST_CHECK_EQUAL(cpu.cycleCount, 44);
+	BOOST_CHECK_EQUAL(cpu.regPC, 0x0206);
+	BOOST_CHECK_EQUAL(cpu.regX, 6);
+	cpu.step();
+	BOOST_CHECK_EQUAL(cpu.cycleCount, 53);
+	BOOST_CHECK_EQUAL(cpu.regPC, 0x0301);
+	BOOST_CHECK_EQUAL(cpu.regY, 2);
+	BOOST_CHECK_EQUAL(ram.bytes[0x01FF], 0x02);
+	BOOST_CHECK_EQUAL(ram.bytes[0x01FE], 0x06);
+	BOOST_CHECK(cpu.interruptDisable());
+
+	// PLP clearing the flag waits the same way.
+	ram.bytes[0x0206] = 0x28;		// PLP
+	ram.bytes[0x0207] = 0xE8;		// INX
+	ram.bytes[0x01F1] = 0x00;
+	cpu.regPC = 0x0206;
+	cpu.regSP = 0xF0;
+	cpu.step();
+	BOOST_CHECK(!cpu.interruptDisable());
+	BOOST_CHECK_EQUAL(cpu.regPC, 0x0207);
+	cpu.step();
+	BOOST_CHECK_EQUAL(cpu.regPC, 0x0208);
+	cpu.step();
+	BOOST_CHECK_EQUAL(cpu.regPC, 0x0301);
+	BOOST_CHECK_EQUAL(ram.bytes[0x01F1], 0x02);
+	BOOST_CHECK_EQUAL(ram.bytes[0x01F0], 0x08);
+}
+
+BOOST_AUTO_TEST_CASE(test_pending_work)
+{
+	Ram ram(64 * 1024);
+	DirectAddressBus bus(ram);
+
+	for (int i = 0; i < 0xFFFF; ++i) {
+		ram.bytes[i] = 0;
+	}
+	ram.bytes[0xFFFA] = 0x00;		// NMI vector $0300
+	ram.bytes[0xFFFB] = 0x03;
+	ram.bytes[0xFFFC] = 0x00;		// reset vector $0200
+	ram.bytes[0xFFFD] = 0x02;
+
+	ram.bytes[0x0200] = 0xE8;		// INX
+	ram.bytes[0x0201] = 0xC8;		// INY
+	ram.bytes[0x0202] = 0x4C;		// JMP $0200
+	ram.bytes[0x0203] = 0x00;
+	ram.bytes[0x0204] = 0x02;
+
+	ram.bytes[0x0300] = 0xE8;		// INX
+	ram.bytes[0x0301] = 0x40;		// RTI
+
+	m6502 cpu(bus);
+	cpu.reset();
+	cpu.regSP = 0xFF;
+	cpu.regX = 0;
+	cpu.regY = 0;
+
+	// A run stops before a breakpoint, runs it when started again and stops on the next pass.
+	cpu.addBreakpoint(0x0201);
+	BOOST_CHECK(cpu.run(100) < 0);
+	BOOST_CHECK_EQUAL(cpu.regPC, 0x0201);
+	BOOST_CHECK_EQUAL(cpu.cycleCount, 2);
+	BOOST_CHECK(cpu.run(100) < 0);
+	BOOST_CHECK_EQUAL(cpu.regPC, 0x0201);
+	BOOST_CHECK_EQUAL(cpu.cycleCount, 9);
+	BOOST_CHECK_EQUAL(cpu.regX, 2);
+	BOOST_CHECK_EQUAL(cpu.regY, 1);
+	cpu.removeBreakpoint(0x0201);
+
+	// The trace handler sees every instruction.
+	std::vector<std::uint16_t> traced;
+	cpu.setTraceHandler([&](const m6502State& state) { traced.push_back(state.regPC); });
+	BOOST_CHECK_EQUAL(cpu.run(7), 0);
+	BOOST_CHECK_EQUAL(traced.size(), 3);
+	BOOST_CHECK_EQUAL(traced[0], 0x0201);
+	BOOST_CHECK_EQUAL(traced[1], 0x0202);
+	BOOST_CHECK_EQUAL(traced[2], 0x0200);
+	cpu.setTraceHandler(nullptr);
+	BOOST_CHECK_EQUAL(cpu.run(7), 0);
+	BOOST_CHECK_EQUAL(traced.size(), 3);
+
+	// An nmi is taken even with interrupts disabled.
+	BOOST_CHECK(cpu.interruptDisable());
+	BOOST_CHECK_EQUAL(cpu.regPC, 0x0201);
+	// Stepping enters it and runs the first instruction of the handler.
+	cpu.triggerNmi();
+	cpu.step();
+	BOOST_CHECK_EQUAL(cpu.regPC, 0x0301);
+	BOOST_CHECK_EQUAL(cpu.cycleCount, 32);
+	cpu.step();
+	BOOST_CHECK_EQUAL(cpu.regPC, 0x0201);
+	BOOST_CHECK_EQUAL(cpu.regSP, 0xFF);
+	BOOST_CHECK_EQUAL(cpu.cycleCount, 38);
+
+	// A requested reset keeps the cycle count running.
+	cpu.regPC = 0x0202;
+	cpu.requestReset();
+	cpu.step();
+	BOOST_CHECK_EQUAL(cpu.regPC, 0x0201);
+	BOOST_CHECK_EQUAL(cpu.cycleCount, 47);
+	BOOST_CHECK_EQUAL(cpu.pendingWork, 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_zero_page_fast_path)
+{
+	Ram ram(64 * 1024);
+	DirectAddressBus bus(ram);
+
+	for (int i = 0; i < 0xFFFF; ++i) {
+		ram.bytes[i] = 0;
+	}
+
+	BOOST_CHECK(bus.plainMemoryPage(0x00) == ram.bytes.data());
+	BOOST_CHECK(bus.plainMemoryPage(0x01) == ram.bytes.data() + 0x100);
+
+	ram.bytes[0x0200] = 0xA9;		// LDA #$42
+	ram.bytes[0x0201] = 0x42;
+	ram.bytes[0x0202] = 0x85;		// STA $10
+	ram.bytes[0x0203] = 0x10;
+	ram.bytes[0x0204] = 0x85;		// STA $20
+	ram.bytes[0x0205] = 0x20;
+	ram.bytes[0x0206] = 0xE6;		// INC $20
+	ram.bytes[0x0207] = 0x20;
+	ram.bytes[0x0208] = 0x48;		// PHA
+	ram.bytes[0x0209] = 0xA5;		// LDA $30
+	ram.bytes[0x020A] = 0x30;
+
+	// Uses the host pointers while zero page is plain memory.
+	m6502 cpu(bus);
+	cpu.reset();
+	cpu.regPC = 0x0200;
+	cpu.regSP = 0xFF;
+	ram.bytes[0x0030] = 0x99;
+	cpu.run(19);
+	BOOST_CHECK_EQUAL(ram.bytes[0x0010], 0x42);
+	BOOST_CHECK_EQUAL(ram.bytes[0x0020], 0x43);
+	BOOST_CHECK_EQUAL(ram.bytes[0x01FF], 0x42);
+	BOOST_CHECK_EQUAL(cpu.regA, 0x99);
+
+	// A handler in zero page sends every zero page access back through the bus.
+	int handlerWrites = 0;
+	bus.addWriteHandler(0x0010, [&](std::uint32_t, std::uint8_t val) { handlerWrites += val; });
+	bus.addReadHandler(0x0030, [](std::uint32_t) { return static_cast<std::uint8_t>(0x55); });
+	BOOST_CHECK(bus.plainMemoryPage(0x00) == nullptr);
+	BOOST_CHECK(bus.plainMemoryPage(0x01) != nullptr);
+
+	for (int i = 0; i < 0x100; ++i) {
+		ram.bytes[i] = 0;
+	}
+	cpu.regPC = 0x0200;
+	cpu.run(19);
+	BOOST_CHECK_EQUAL(handlerWrites, 0x42);
+	BOOST_CHECK_EQUAL(ram.bytes[0x0010], 0x00);
+	BOOST_CHECK_EQUAL(ram.bytes[0x0020], 0x43);
+	BOOST_CHECK_EQUAL(ram.bytes[0x01FE], 0x42);
+	BOOST_CHECK_EQUAL(cpu.regA, 0x55);
+}
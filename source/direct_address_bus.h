@@ -1,8 +1,22 @@
 #pragma once
 #include "address_bus.h"
 #include "ram.h"
-#include <functional>
-#include <map>
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+class RomRegion
+{
+public:
+	RomRegion(std::uint32_t s, const std::uint8_t* d, std::uint32_t l) : start(s), data(d), length(l) {}
+	std::uint32_t start;
+	const std::uint8_t* data;
+	std::uint32_t length;
+};
 
 class MirrorRegion
 {
@@ -13,32 +27,403 @@ public:
 	std::uint32_t target;
 };
 
-class DirectAddressBus : public AddressBus
+class BankWindow
+{
+public:
+	BankWindow(std::uint32_t s, std::uint32_t l, const std::uint8_t* d, int n, bool w) : start(s), length(l), data(d), numBanks(n), writable(w) {}
+	std::uint32_t start;
+	std::uint32_t length;
+	const std::uint8_t* data;
+	int numBanks;
+	bool writable;
+	int bank = 0;
+	// Pages mirrored onto the window, as the mirror page and the page's offset into the window.
+	std::vector<std::pair<std::uint8_t, std::uint32_t>> mirrors;
+};
+
+/*
+A bus handler callable, stored in place rather than on the heap. It holds anything
+trivially copyable that fits, such as a lambda capturing a few references.
+*/
+template <class Signature>
+class BusHandler;
+
+template <class Result, class... Args>
+class BusHandler<Result(Args...)>
+{
+public:
+	template <class Handler>
+	BusHandler(Handler handler)
+	{
+		static_assert(sizeof(Handler) <= sizeof(storage), "bus handlers must be small enough to store in place");
+		static_assert(std::is_trivially_copyable<Handler>::value, "bus handlers must be trivially copyable");
+		new (storage) Handler(handler);
+		invoke = [](const void* stored, Args... args) -> Result {
+			return (*static_cast<const Handler*>(stored))(args...);
+		};
+	}
+
+	Result operator()(Args... args) const { return invoke(storage, args...); }
+
+private:
+	Result (*invoke)(const void* stored, Args... args);
+	alignas(void*) unsigned char storage[4 * sizeof(void*)];
+};
+
+typedef BusHandler<std::uint8_t(std::uint32_t address)> ReadHandler;
+typedef BusHandler<void(std::uint32_t address, std::uint8_t val)> WriteHandler;
+
+/*
+Final and defined inline so that a cpu templated on this bus (m6502Core<DirectAddressBus>)
+gets direct, inlinable calls rather than virtual ones.
+
+The 64K address space is split into 256 byte pages, each pointing at the host memory it
+maps to. Mirrors are resolved into the table when they are set, so an access is one table
+index and a load however many mirrors there are. Reads and writes have separate tables so
+ROM pages can be read in place while writes to them are thrown away.
+
+Pages with read or write handlers have a trap bit set, so accesses to any other page go
+straight to memory. In a trapped page each address has an index into a dense array of
+handlers, 0 for none.
+
+Bank windows are pages whose table entries are rewritten when a bank is selected, so a
+switch costs a store per page in the window and accesses cost nothing extra.
+*/
+class DirectAddressBus final : public AddressBus
 {
 public:
-	DirectAddressBus(Ram& r) : ram(r) {}
-	std::uint8_t readByte(std::uint32_t address);
-	void writeByte(std::uint32_t address, std::uint8_t val);
+	DirectAddressBus(Ram& r) : ram(&r)
+	{
+		std::memset(unmapped, 0xFF, sizeof(unmapped));
+		mapPages();
+	}
+	std::uint8_t readByte(std::uint32_t address) override
+	{
+		std::uint32_t page = (address >> 8) & 0xFF;
+		if ((pageTraps[page] & READ_TRAP) != 0) {
+			std::uint16_t index = readHandlerIndex[address & 0xFFFF];
+			if (index != 0) {
+				return readHandlers[index - 1](address);
+			}
+		}
+		return readPages[page][address & 0xFF];
+	}
+
+	void writeByte(std::uint32_t address, std::uint8_t val) override
+	{
+		std::uint32_t page = (address >> 8) & 0xFF;
+		if ((pageTraps[page] & WRITE_TRAP) != 0) {
+			std::uint16_t index = writeHandlerIndex[address & 0xFFFF];
+			if (index != 0) {
+				writeHandlers[index - 1](address, val);
+				return;
+			}
+		}
+		writePages[page][address & 0xFF] = val;
+	}
+
+	void setByte(std::uint32_t address, std::uint8_t val) override
+	{
+		writePages[(address >> 8) & 0xFF][address & 0xFF] = val;
+	}
+
+	std::uint16_t readWord(std::uint32_t address) override
+	{
+		std::uint32_t page = (address >> 8) & 0xFF;
+		if ((address & 0xFF) != 0xFF && (pageTraps[page] & READ_TRAP) == 0) {
+			const std::uint8_t* bytes = readPages[page] + (address & 0xFF);
+			return bytes[0] | (bytes[1] << 8);
+		}
+		return readByte(address) | (readByte(address + 1) << 8);
+	}
+
+	// Copies a page at a time, going byte by byte only through pages with handlers.
+	void readBlock(std::uint32_t address, std::uint8_t* dest, std::uint32_t length) override
+	{
+		while (length > 0) {
+			std::uint32_t page = (address >> 8) & 0xFF;
+			std::uint32_t chunk = std::min(length, 0x100 - (address & 0xFF));
+			if ((pageTraps[page] & READ_TRAP) == 0) {
+				std::memcpy(dest, readPages[page] + (address & 0xFF), chunk);
+			}
+			else {
+				for (std::uint32_t i = 0; i < chunk; ++i) {
+					dest[i] = readByte(address + i);
+				}
+			}
+			address += chunk;
+			dest += chunk;
+			length -= chunk;
+		}
+	}
+
+	void writeBlock(std::uint32_t address, const std::uint8_t* src, std::uint32_t length) override
+	{
+		while (length > 0) {
+			std::uint32_t page = (address >> 8) & 0xFF;
+			std::uint32_t chunk = std::min(length, 0x100 - (address & 0xFF));
+			if ((pageTraps[page] & WRITE_TRAP) == 0) {
+				std::memcpy(writePages[page] + (address & 0xFF), src, chunk);
+			}
+			else {
+				for (std::uint32_t i = 0; i < chunk; ++i) {
+					writeByte(address + i, src[i]);
+				}
+			}
+			address += chunk;
+			src += chunk;
+			length -= chunk;
+		}
+	}
 
-	void setByte(std::uint32_t address, std::uint8_t val);
+	/**
+	 * Maps the bus onto different memory. Any cpu holding page pointers from
+	 * plainMemoryPage must look them up again.
+	*/
+	void setRam(Ram& ramIn) { ram = &ramIn; mapPages(); }
 
-	void setRam(Ram& ramIn) { ram = ramIn; }
+	/**
+	 * Maps length bytes of ROM at data, such as a MappedRom, to start. Reads come
+	 * straight from data, writes are ignored. start and length must be whole pages, and
+	 * data must stay valid for as long as the bus uses it.
+	*/
+	void mapRom(std::uint32_t start, const std::uint8_t* data, std::uint32_t length) {
+		if ((start & 0xFF) != 0 || (length & 0xFF) != 0 || length == 0) {
+			throw std::invalid_argument("ROM regions must cover whole pages");
+		}
+		romRegions.push_back(RomRegion(start, data, length));
+		mapPages();
+	}
 
 	/**
-	 * Causes the memory region at start -> end to be mapped to target.
+	 * Causes the memory region at start -> end to be mapped to target. The region must
+	 * cover whole pages. A page aligned target follows whatever the target page maps to,
+	 * ROM included; otherwise target is an offset into the ram. Where regions overlap the
+	 * first one set is used.
 	*/
 	void setMirror(std::uint32_t start, std::uint32_t end, std::uint32_t target) {
+		if ((start & 0xFF) != 0 || (end & 0xFF) != 0xFF || end < start) {
+			throw std::invalid_argument("mirror regions must cover whole pages");
+		}
 		mirrorRegions.push_back(MirrorRegion(start, end, target));
+		mapPages();
 	}
 
-	void addWriteHandler(std::uint32_t addr, std::function<void(std::uint32_t, std::uint8_t)> handler) {
-		writeHandlers[addr] = handler;
+	/**
+	 * Maps a window of length bytes at start onto one of numBanks banks laid out back to
+	 * back at data, each length bytes long, and returns the window's id for selectBank.
+	 * The window starts on bank 0. Writes to the window are ignored, as for ROM. start and
+	 * length must be whole pages, and data must stay valid for as long as the bus uses it.
+	*/
+	int addRomBanks(std::uint32_t start, std::uint32_t length, const std::uint8_t* data, int numBanks) {
+		return addBankWindow(BankWindow(start, length, data, numBanks, false));
+	}
+
+	// As addRomBanks, but writes go to the selected bank.
+	int addRamBanks(std::uint32_t start, std::uint32_t length, std::uint8_t* data, int numBanks) {
+		return addBankWindow(BankWindow(start, length, data, numBanks, true));
+	}
+
+	/**
+	 * Switches window to bank, taken modulo the number of banks the way a bank register
+	 * ignores its unused bits. Only the window's pages and the pages mirroring them are
+	 * touched, so this is cheap enough to call from a write handler. A cpu caching code
+	 * from the window must have the window's pages invalidated. bank is taken as
+	 * unsigned, so a negative value selects the bank its low bits give.
+	*/
+	void selectBank(int window, int bank)
+	{
+		if (window < 0 || window >= static_cast<int>(bankWindows.size())) {
+			throw std::out_of_range("no such bank window");
+		}
+		BankWindow& bankWindow = bankWindows[window];
+		bankWindow.bank = static_cast<int>(static_cast<unsigned>(bank) % static_cast<unsigned>(bankWindow.numBanks));
+		for (std::uint32_t offset = 0; offset < bankWindow.length && bankWindow.start + offset <= 0xFFFF; offset += 0x100) {
+			setBankPage(bankWindow, (bankWindow.start + offset) >> 8, offset);
+		}
+		for (const auto& mirror : bankWindow.mirrors) {
+			setBankPage(bankWindow, mirror.first, mirror.second);
+		}
+	}
+
+	int selectedBank(int window) const { return bankWindows[window].bank; }
+
+	/**
+	 * Calls handler instead of writing to memory for writes to addr, replacing any handler
+	 * already there.
+	*/
+	void addWriteHandler(std::uint32_t addr, WriteHandler handler) {
+		addHandler(writeHandlerIndex, writeHandlers, addr, handler);
+		pageTraps[(addr >> 8) & 0xFF] |= WRITE_TRAP;
+	}
+
+	/**
+	 * Calls handler for the value of reads from addr, replacing any handler already there.
+	 * setByte still writes the memory underneath, which the handler can ignore.
+	*/
+	void addReadHandler(std::uint32_t addr, ReadHandler handler) {
+		addHandler(readHandlerIndex, readHandlers, addr, handler);
+		pageTraps[(addr >> 8) & 0xFF] |= READ_TRAP;
+	}
+
+	std::uint8_t* plainMemoryPage(std::uint32_t page) override
+	{
+		page &= 0xFF;
+		bool plain = pageTraps[page] == 0 && readPages[page] == writePages[page];
+		return plain ? writePages[page] : nullptr;
+	}
+
+	bool hasReadHandler(std::uint32_t address) const override
+	{
+		return (pageTraps[(address >> 8) & 0xFF] & READ_TRAP) != 0 && readHandlerIndex[address & 0xFFFF] != 0;
 	}
 
 private:
-	Ram & ram;
+	template <class Handler>
+	static void addHandler(std::vector<std::uint16_t>& handlerIndex, std::vector<Handler>& handlers, std::uint32_t addr, const Handler& handler)
+	{
+		if (handlerIndex.empty()) {
+			handlerIndex.resize(0x10000);
+		}
+		std::uint16_t& index = handlerIndex[addr & 0xFFFF];
+		if (index != 0) {
+			handlers[index - 1] = handler;
+			return;
+		}
+		handlers.push_back(handler);
+		index = static_cast<std::uint16_t>(handlers.size());
+	}
+
+	int addBankWindow(const BankWindow& bankWindow)
+	{
+		if ((bankWindow.start & 0xFF) != 0 || (bankWindow.length & 0xFF) != 0 || bankWindow.length == 0) {
+			throw std::invalid_argument("bank windows must cover whole pages");
+		}
+		if (bankWindow.numBanks <= 0) {
+			throw std::invalid_argument("bank windows need at least one bank");
+		}
+		bankWindows.push_back(bankWindow);
+		mapPages();
+		return static_cast<int>(bankWindows.size() - 1);
+	}
+
+	void setBankPage(const BankWindow& bankWindow, std::uint32_t page, std::uint32_t offset)
+	{
+		const std::uint8_t* bytes = bankWindow.data + static_cast<std::size_t>(bankWindow.bank) * bankWindow.length + offset;
+		readPages[page] = bytes;
+		writePages[page] = bankWindow.writable ? const_cast<std::uint8_t*>(bytes) : discarded;
+	}
+
+	void mapPages()
+	{
+		for (std::uint32_t page = 0; page < 256; ++page) {
+			readPages[page] = hostReadPage(page << 8);
+			writePages[page] = hostWritePage(page << 8);
+		}
+		for (const auto& rom : romRegions) {
+			for (std::uint32_t offset = 0; offset < rom.length && rom.start + offset <= 0xFFFF; offset += 0x100) {
+				std::uint32_t page = (rom.start + offset) >> 8;
+				readPages[page] = rom.data + offset;
+				writePages[page] = discarded;
+			}
+		}
+		// Banked pages are never plain memory, as a cpu caching them would miss a switch.
+		for (auto& traps : pageTraps) {
+			traps &= ~BANKED;
+		}
+		for (auto& bankWindow : bankWindows) {
+			bankWindow.mirrors.clear();
+			for (std::uint32_t offset = 0; offset < bankWindow.length && bankWindow.start + offset <= 0xFFFF; offset += 0x100) {
+				std::uint32_t page = (bankWindow.start + offset) >> 8;
+				setBankPage(bankWindow, page, offset);
+				pageTraps[page] |= BANKED;
+			}
+		}
+
+		// Mirrors follow the map without mirrors, so take a copy to resolve them against.
+		const std::uint8_t* baseReadPages[256];
+		std::uint8_t* baseWritePages[256];
+		std::memcpy(baseReadPages, readPages, sizeof(readPages));
+		std::memcpy(baseWritePages, writePages, sizeof(writePages));
 
+		// The page each mirror page follows, or NO_TARGET.
+		std::uint32_t mirrorTargets[256];
+		for (auto& target : mirrorTargets) {
+			target = NO_TARGET;
+		}
+
+		// Later regions first so the first one set wins where they overlap.
+		for (auto region = mirrorRegions.rbegin(); region != mirrorRegions.rend(); ++region) {
+			for (std::uint32_t address = region->start; address <= region->end && address <= 0xFFFF; address += 0x100) {
+				std::uint32_t target = address + region->target - region->start;
+				if ((target & 0xFF) == 0 && target <= 0xFFFF) {
+					readPages[address >> 8] = baseReadPages[(target >> 8) & 0xFF];
+					writePages[address >> 8] = baseWritePages[(target >> 8) & 0xFF];
+					mirrorTargets[address >> 8] = target;
+				}
+				else {
+					readPages[address >> 8] = hostReadPage(target);
+					writePages[address >> 8] = hostWritePage(target);
+					mirrorTargets[address >> 8] = NO_TARGET;
+				}
+			}
+		}
+		for (std::uint32_t page = 0; page < 256; ++page) {
+			if (mirrorTargets[page] != NO_TARGET) {
+				trackBankMirror(page, mirrorTargets[page]);
+			}
+		}
+	}
+
+	// Records a mirror of a banked page so that selectBank moves it along with the window.
+	void trackBankMirror(std::uint32_t page, std::uint32_t target)
+	{
+		for (auto& bankWindow : bankWindows) {
+			if (target >= bankWindow.start && target - bankWindow.start < bankWindow.length) {
+				bankWindow.mirrors.emplace_back(static_cast<std::uint8_t>(page), target - bankWindow.start);
+				pageTraps[page] |= BANKED;
+				return;
+			}
+		}
+	}
+
+	// Pages past the end of the ram read as 0xFF and throw writes away.
+	const std::uint8_t* hostReadPage(std::uint32_t address) const
+	{
+		if (address + 0x100 > ram->bytes.size()) {
+			return unmapped;
+		}
+		return ram->bytes.data() + address;
+	}
+
+	std::uint8_t* hostWritePage(std::uint32_t address)
+	{
+		if (address + 0x100 > ram->bytes.size()) {
+			return discarded;
+		}
+		return ram->bytes.data() + address;
+	}
+
+	Ram* ram;
+
+	std::vector<RomRegion> romRegions;
 	std::vector<MirrorRegion> mirrorRegions;
+	std::vector<BankWindow> bankWindows;
+	const std::uint8_t* readPages[256];
+	std::uint8_t* writePages[256];
+	// What pages past the end of the ram read as. Nothing writes to it after the constructor.
+	std::uint8_t unmapped[256];
+	// Where writes to ROM and to pages past the end of the ram go.
+	std::uint8_t discarded[256];
+
+	static const std::uint8_t READ_TRAP = 0x01;
+	static const std::uint8_t WRITE_TRAP = 0x02;
+	static const std::uint8_t BANKED = 0x04;
+	static const std::uint32_t NO_TARGET = 0xFFFFFFFF;
 
-	std::map<std::uint32_t, std::function<void(std::uint32_t, std::uint8_t)>> writeHandlers;
+	std::uint8_t pageTraps[256] = {};
+	std::vector<std::uint16_t> readHandlerIndex;
+	std::vector<ReadHandler> readHandlers;
+	std::vector<std::uint16_t> writeHandlerIndex;
+	std::vector<WriteHandler> writeHandlers;
 };
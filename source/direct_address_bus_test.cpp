@@ -0,0 +1,262 @@
+#define BOOST_TEST_MODULE direct_address_bus_test
+#include <boost/test/included/unit_test.hpp>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "ram.h"
+#include "direct_address_bus.h"
+#include "cpu/m6502.h"
+
+BOOST_AUTO_TEST_CASE(test_direct_bus_mirrors)
+{
+	Ram ram(64 * 1024);
+	DirectAddressBus bus(ram);
+
+	bus.setMirror(0xFF00, 0xFFFF, 0x3F00);
+	bus.setMirror(0x8000, 0x81FF, 0x1080);
+	// Overlaps the first mirror, which wins.
+	bus.setMirror(0xF000, 0xFFFF, 0x2000);
+
+	ram.bytes[0x3F12] = 0x34;
+	BOOST_CHECK_EQUAL(bus.readByte(0xFF12), 0x34);
+	ram.bytes[0x2E12] = 0x56;
+	BOOST_CHECK_EQUAL(bus.readByte(0xFE12), 0x56);
+
+	// The target need not be page aligned.
+	bus.setByte(0x81FF, 0x78);
+	BOOST_CHECK_EQUAL(ram.bytes[0x127F], 0x78);
+	bus.writeByte(0x8000, 0x9A);
+	BOOST_CHECK_EQUAL(ram.bytes[0x1080], 0x9A);
+	BOOST_CHECK_EQUAL(bus.readByte(0x1080), 0x9A);
+
+	// Addresses outside the mirrors are not moved.
+	bus.writeByte(0x8200, 0xBC);
+	BOOST_CHECK_EQUAL(ram.bytes[0x8200], 0xBC);
+
+	BOOST_CHECK_THROW(bus.setMirror(0x8010, 0x80FF, 0x0000), std::invalid_argument);
+	BOOST_CHECK_THROW(bus.setMirror(0x8000, 0x8010, 0x0000), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(test_unmapped_pages)
+{
+	Ram ram(32 * 1024);
+	DirectAddressBus bus(ram);
+
+	// Past the end of the ram reads as 0xFF whatever has been written there.
+	BOOST_CHECK_EQUAL(bus.readByte(0x8000), 0xFF);
+	bus.writeByte(0x8010, 0x12);
+	bus.setByte(0xC020, 0x34);
+	BOOST_CHECK_EQUAL(bus.readByte(0x8010), 0xFF);
+	BOOST_CHECK_EQUAL(bus.readByte(0xC020), 0xFF);
+	BOOST_CHECK_EQUAL(bus.readWord(0x80FF), 0xFFFF);
+	BOOST_CHECK(bus.plainMemoryPage(0x80) == nullptr);
+
+	std::uint8_t block[2];
+	bus.writeByte(0x7FFF, 0x56);
+	bus.readBlock(0x7FFF, block, 2);
+	BOOST_CHECK_EQUAL(block[0], 0x56);
+	BOOST_CHECK_EQUAL(block[1], 0xFF);
+}
+
+BOOST_AUTO_TEST_CASE(test_write_handlers)
+{
+	Ram ram(64 * 1024);
+	DirectAddressBus bus(ram);
+
+	std::uint32_t lastAddress = 0;
+	int firstWrites = 0;
+	int secondWrites = 0;
+	bus.addWriteHandler(0x5100, [&](std::uint32_t address, std::uint8_t val) { lastAddress = address; firstWrites += val; });
+	bus.addWriteHandler(0x5101, [&](std::uint32_t address, std::uint8_t val) { lastAddress = address; secondWrites += val; });
+
+	bus.writeByte(0x5100, 3);
+	bus.writeByte(0x5101, 4);
+	BOOST_CHECK_EQUAL(firstWrites, 3);
+	BOOST_CHECK_EQUAL(secondWrites, 4);
+	BOOST_CHECK_EQUAL(lastAddress, 0x5101);
+	BOOST_CHECK_EQUAL(ram.bytes[0x5100], 0);
+	BOOST_CHECK_EQUAL(ram.bytes[0x5101], 0);
+
+	// Other addresses in a page with handlers are plain memory, and setByte bypasses handlers.
+	bus.writeByte(0x5102, 5);
+	BOOST_CHECK_EQUAL(ram.bytes[0x5102], 5);
+	bus.setByte(0x5100, 6);
+	BOOST_CHECK_EQUAL(ram.bytes[0x5100], 6);
+	BOOST_CHECK_EQUAL(firstWrites, 3);
+
+	// Adding a handler at the same address replaces the old one.
+	bus.addWriteHandler(0x5100, [&](std::uint32_t, std::uint8_t val) { secondWrites += val; });
+	bus.writeByte(0x5100, 7);
+	BOOST_CHECK_EQUAL(firstWrites, 3);
+	BOOST_CHECK_EQUAL(secondWrites, 11);
+}
+
+BOOST_AUTO_TEST_CASE(test_read_handlers)
+{
+	Ram ram(64 * 1024);
+	DirectAddressBus bus(ram);
+
+	int reads = 0;
+	bus.addReadHandler(0x5101, [&](std::uint32_t) { ++reads; return static_cast<std::uint8_t>(reads >= 10 ? 0x80 : 0); });
+	BOOST_CHECK(bus.hasReadHandler(0x5101));
+	BOOST_CHECK(!bus.hasReadHandler(0x5102));
+	BOOST_CHECK(!bus.hasReadHandler(0x0010));
+
+	// Other addresses in the page are plain memory.
+	bus.writeByte(0x5102, 0x12);
+	BOOST_CHECK_EQUAL(bus.readByte(0x5102), 0x12);
+
+	// Waits for bit 7 of the port. The loop reads the port so must run every pass.
+	ram.bytes[0x0200] = 0xAD;		// LDA $5101
+	ram.bytes[0x0201] = 0x01;
+	ram.bytes[0x0202] = 0x51;
+	ram.bytes[0x0203] = 0x10;		// BPL $0200
+	ram.bytes[0x0204] = 0xFB;
+	ram.bytes[0x0205] = 0xE8;		// INX
+
+	m6502 cpu(bus);
+	cpu.reset();
+	cpu.enableCodeCache(0x0200, 0x02FF);
+	cpu.regPC = 0x0200;
+	cpu.regX = 0;
+	cpu.cycleCount = 0;
+
+	// Each pass is 7 cycles, and the tenth read ends the loop.
+	cpu.run(100);
+	BOOST_CHECK_EQUAL(reads, 10);
+	BOOST_CHECK_EQUAL(cpu.regX, 1);
+	BOOST_CHECK_EQUAL(cpu.regA, 0x80);
+}
+
+BOOST_AUTO_TEST_CASE(test_bus_block_access)
+{
+	Ram ram(64 * 1024);
+	DirectAddressBus bus(ram);
+
+	for (int i = 0; i < 0xFFFF; ++i) {
+		ram.bytes[i] = i & 0xFF;
+	}
+
+	int handlerWrites = 0;
+	bus.setMirror(0xFF00, 0xFFFF, 0x3F00);
+	bus.addReadHandler(0x5101, [](std::uint32_t) { return static_cast<std::uint8_t>(0xAB); });
+	bus.addWriteHandler(0x5100, [&](std::uint32_t, std::uint8_t val) { handlerWrites += val; });
+
+	// Words within a page, across a page, into a mirror and through a read handler.
+	BOOST_CHECK_EQUAL(bus.readWord(0x1234), 0x3534);
+	BOOST_CHECK_EQUAL(bus.readWord(0x12FF), 0x00FF);
+	ram.bytes[0x3FFC] = 0x21;
+	ram.bytes[0x3FFD] = 0x43;
+	BOOST_CHECK_EQUAL(bus.readWord(0xFFFC), 0x4321);
+	BOOST_CHECK_EQUAL(bus.readWord(0x5100), 0xAB00);
+
+	// A block read across pages picks up the handler and the mirror.
+	std::uint8_t block[0x300];
+	bus.readBlock(0x50F0, block, 0x20);
+	BOOST_CHECK_EQUAL(block[0x0F], 0xFF);
+	BOOST_CHECK_EQUAL(block[0x10], 0x00);
+	BOOST_CHECK_EQUAL(block[0x11], 0xAB);
+	BOOST_CHECK_EQUAL(block[0x12], 0x02);
+	bus.readBlock(0xFEFF, block, 2);
+	BOOST_CHECK_EQUAL(block[0], 0xFF);
+	BOOST_CHECK_EQUAL(block[1], ram.bytes[0x3F00]);
+
+	// A block write goes through the write handler and lands in memory elsewhere.
+	for (int i = 0; i < 0x300; ++i) {
+		block[i] = 1;
+	}
+	bus.writeBlock(0x5000, block, 0x300);
+	BOOST_CHECK_EQUAL(handlerWrites, 1);
+	BOOST_CHECK_EQUAL(ram.bytes[0x5000], 1);
+	BOOST_CHECK_EQUAL(ram.bytes[0x50FF], 1);
+	BOOST_CHECK_EQUAL(ram.bytes[0x5100], 0x00);
+	BOOST_CHECK_EQUAL(ram.bytes[0x5101], 1);
+	BOOST_CHECK_EQUAL(ram.bytes[0x52FF], 1);
+	BOOST_CHECK_EQUAL(ram.bytes[0x5300], 0x00);
+}
+
+BOOST_AUTO_TEST_CASE(test_bank_switching)
+{
+	Ram ram(64 * 1024);
+	DirectAddressBus bus(ram);
+
+	// Four 8K ROM banks, each filled with its bank number, and two 256 byte RAM banks.
+	std::vector<std::uint8_t> romBanks(4 * 0x2000);
+	for (std::size_t i = 0; i < romBanks.size(); ++i) {
+		romBanks[i] = static_cast<std::uint8_t>(i / 0x2000);
+	}
+	std::vector<std::uint8_t> ramBanks(2 * 0x100, 0);
+
+	int romWindow = bus.addRomBanks(0x8000, 0x2000, romBanks.data(), 4);
+	int ramWindow = bus.addRamBanks(0x6000, 0x100, ramBanks.data(), 2);
+	bus.setMirror(0xC000, 0xC0FF, 0x8000);
+	bus.addWriteHandler(0x5000, [&bus, romWindow](std::uint32_t, std::uint8_t val) { bus.selectBank(romWindow, val); });
+	BOOST_CHECK_EQUAL(bus.selectedBank(romWindow), 0);
+	BOOST_CHECK(bus.plainMemoryPage(0x60) == nullptr);
+
+	// The bank register switches the window and its mirror, and writes to ROM are dropped.
+	bus.writeByte(0x8010, 0xFF);
+	BOOST_CHECK_EQUAL(bus.readByte(0x8010), 0);
+	bus.writeByte(0x5000, 2);
+	BOOST_CHECK_EQUAL(bus.readByte(0x9FFF), 2);
+	BOOST_CHECK_EQUAL(bus.readByte(0xC080), 2);
+	bus.writeByte(0x5000, 7);
+	BOOST_CHECK_EQUAL(bus.selectedBank(romWindow), 3);
+	BOOST_CHECK_EQUAL(bus.readWord(0x8000), 0x0303);
+
+	// RAM banks keep their own contents.
+	bus.writeByte(0x6020, 0x11);
+	bus.selectBank(ramWindow, 1);
+	BOOST_CHECK_EQUAL(bus.readByte(0x6020), 0);
+	bus.writeByte(0x6020, 0x22);
+	bus.selectBank(ramWindow, 0);
+	BOOST_CHECK_EQUAL(bus.readByte(0x6020), 0x11);
+	BOOST_CHECK_EQUAL(ramBanks[0x120], 0x22);
+
+	// Rebuilding the map keeps the selected banks.
+	bus.setMirror(0xD000, 0xD0FF, 0x8100);
+	BOOST_CHECK_EQUAL(bus.readByte(0x8000), 3);
+	BOOST_CHECK_EQUAL(bus.readByte(0xD000), 3);
+
+	// A program switching banks as it goes.
+	ram.bytes[0x0200] = 0xA9;		// LDA #$01
+	ram.bytes[0x0201] = 0x01;
+	ram.bytes[0x0202] = 0x8D;		// STA $5000
+	ram.bytes[0x0203] = 0x00;
+	ram.bytes[0x0204] = 0x50;
+	ram.bytes[0x0205] = 0xAD;		// LDA $8000
+	ram.bytes[0x0206] = 0x00;
+	ram.bytes[0x0207] = 0x80;
+	ram.bytes[0x0208] = 0x85;		// STA $10
+	ram.bytes[0x0209] = 0x10;
+	ram.bytes[0x020A] = 0xA9;		// LDA #$02
+	ram.bytes[0x020B] = 0x02;
+	ram.bytes[0x020C] = 0x8D;		// STA $5000
+	ram.bytes[0x020D] = 0x00;
+	ram.bytes[0x020E] = 0x50;
+	ram.bytes[0x020F] = 0xAD;		// LDA $D000
+	ram.bytes[0x0210] = 0x00;
+	ram.bytes[0x0211] = 0xD0;
+	ram.bytes[0x0212] = 0x85;		// STA $11
+	ram.bytes[0x0213] = 0x11;
+
+	m6502 cpu(bus);
+	cpu.reset();
+	cpu.enableCodeCache(0x0200, 0x02FF);
+	cpu.regPC = 0x0200;
+	cpu.cycleCount = 0;
+	cpu.run(26);
+	BOOST_CHECK_EQUAL(ram.bytes[0x10], 1);
+	BOOST_CHECK_EQUAL(ram.bytes[0x11], 2);
+
+	BOOST_CHECK_THROW(bus.addRomBanks(0x8010, 0x100, romBanks.data(), 4), std::invalid_argument);
+	BOOST_CHECK_THROW(bus.addRomBanks(0x8000, 0x100, romBanks.data(), 0), std::invalid_argument);
+
+	// A negative bank keeps its low bits, and unknown windows are rejected.
+	bus.selectBank(romWindow, -1);
+	BOOST_CHECK_EQUAL(bus.selectedBank(romWindow), 3);
+	BOOST_CHECK_EQUAL(bus.readByte(0x8000), 3);
+	BOOST_CHECK_THROW(bus.selectBank(-1, 0), std::out_of_range);
+	BOOST_CHECK_THROW(bus.selectBank(2, 0), std::out_of_range);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+/*
+One bit per item, such as a cell of a tile display, set when something changes the item
+and cleared once it has been redrawn. Checking for no changes at all looks at a word per
+64 items.
+*/
+class DirtyBitmap
+{
+public:
+	// Starts with every item marked, so the first pass visits them all.
+	DirtyBitmap(std::uint32_t sizeIn) : size(sizeIn), words((sizeIn + 63) / 64) { markAll(); }
+
+	void mark(std::uint32_t index) { words[index / 64] |= std::uint64_t(1) << (index % 64); }
+
+	void markAll()
+	{
+		for (std::uint32_t index = 0; index < words.size(); ++index) {
+			words[index] = ~std::uint64_t(0);
+		}
+		if (size % 64 != 0) {
+			words.back() = (std::uint64_t(1) << (size % 64)) - 1;
+		}
+	}
+
+	bool test(std::uint32_t index) const { return (words[index / 64] & (std::uint64_t(1) << (index % 64))) != 0; }
+
+	bool any() const
+	{
+		for (auto word : words) {
+			if (word != 0) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void clear()
+	{
+		for (auto& word : words) {
+			word = 0;
+		}
+	}
+
+private:
+	std::uint32_t size;
+	std::vector<std::uint64_t> words;
+};
@@ -0,0 +1,37 @@
+#include "frame_buffer.h"
+
+FrameBuffer::FrameBuffer(int width, int height, Format format)
+	: frameWidth(width)
+	, frameHeight(height)
+	, pixelFormat(format)
+{
+	rowPitch = (width * bytesPerPixel() + ROW_ALIGNMENT - 1) & ~(ROW_ALIGNMENT - 1);
+
+	// The extra is for aligning the first row.
+	std::size_t size = static_cast<std::size_t>(rowPitch) * height + ROW_ALIGNMENT;
+	allocation.reset(new std::uint8_t[size]());
+	std::uintptr_t address = reinterpret_cast<std::uintptr_t>(allocation.get());
+	base = allocation.get() + ((ROW_ALIGNMENT - address % ROW_ALIGNMENT) % ROW_ALIGNMENT);
+}
+
+std::uint32_t FrameBuffer::mapRGB(std::uint8_t r, std::uint8_t g, std::uint8_t b) const
+{
+	if (pixelFormat == Format::ARGB32) {
+		return 0xFF000000u | (r << 16) | (g << 8) | b;
+	}
+	return (r & 0xE0) | ((g >> 3) & 0x1C) | (b >> 6);
+}
+
+std::uint64_t FrameBuffer::hash() const
+{
+	// FNV-1a
+	std::uint64_t hash = 0xcbf29ce484222325ull;
+	const int rowBytes = frameWidth * bytesPerPixel();
+	for (int y = 0; y < frameHeight; ++y) {
+		const std::uint8_t* bytes = row(y);
+		for (int x = 0; x < rowBytes; ++x) {
+			hash = (hash ^ bytes[x]) * 0x100000001b3ull;
+		}
+	}
+	return hash;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/*
+Pixels that video code draws into, with nothing tied to a window, so frames can be made
+headless and handed to whatever wants them: a window, a capture, a hash. Rows are padded
+to ROW_ALIGNMENT bytes so each one starts on a cache line.
+
+INDEXED8 pixels are RRRGGGBB, so 0x00 is black and 0xFF white as in ARGB32, and the
+palette matches SDL's RGB332 format.
+*/
+class FrameBuffer
+{
+public:
+	enum class Format
+	{
+		INDEXED8,
+		ARGB32
+	};
+
+	class Rect
+	{
+	public:
+		int x;
+		int y;
+		int w;
+		int h;
+	};
+
+	static const int ROW_ALIGNMENT = 64;
+
+	// Starts out black.
+	FrameBuffer(int width, int height, Format format);
+
+	FrameBuffer(const FrameBuffer&) = delete;
+	FrameBuffer& operator=(const FrameBuffer&) = delete;
+
+	int width() const { return frameWidth; }
+	int height() const { return frameHeight; }
+	Format format() const { return pixelFormat; }
+	int bytesPerPixel() const { return pixelFormat == Format::ARGB32 ? 4 : 1; }
+	// Bytes from the start of one row to the next.
+	int pitch() const { return rowPitch; }
+
+	std::uint8_t* pixels() { return base; }
+	const std::uint8_t* pixels() const { return base; }
+	std::uint8_t* row(int y) { return base + y * rowPitch; }
+	const std::uint8_t* row(int y) const { return base + y * rowPitch; }
+
+	// The pixel value closest to a colour.
+	std::uint32_t mapRGB(std::uint8_t r, std::uint8_t g, std::uint8_t b) const;
+
+	// A hash of the visible pixels, leaving out row padding, for comparing frames.
+	std::uint64_t hash() const;
+
+private:
+	int frameWidth;
+	int frameHeight;
+	Format pixelFormat;
+	int rowPitch;
+	std::unique_ptr<std::uint8_t[]> allocation;
+	std::uint8_t* base;
+};
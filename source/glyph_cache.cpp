@@ -0,0 +1,42 @@
+#include "glyph_cache.h"
+#include <cstring>
+
+GlyphCache::GlyphCache(int bytesPerPixelIn)
+	: bytesPerPixel(bytesPerPixelIn)
+	, glyphBytes(GLYPH_SIZE * GLYPH_SIZE * bytesPerPixelIn)
+	, pixels(NUM_GLYPHS * glyphBytes)
+{
+	invalidateAll();
+}
+
+void GlyphCache::invalidateAll()
+{
+	for (auto& glyphDirty : dirty) {
+		glyphDirty = true;
+	}
+}
+
+bool GlyphCache::update(AddressBus& bus, std::uint32_t address)
+{
+	bool anyRebuilt = false;
+	for (int code = 0; code < NUM_GLYPHS; ++code) {
+		rebuilt[code] = dirty[code];
+		if (!dirty[code]) {
+			continue;
+		}
+		dirty[code] = false;
+		anyRebuilt = true;
+
+		std::uint8_t bits[GLYPH_SIZE];
+		bus.readBlock(address + code * GLYPH_SIZE, bits, GLYPH_SIZE);
+		std::uint8_t* tgt = pixels.data() + code * glyphBytes;
+		for (int row = 0; row < GLYPH_SIZE; ++row) {
+			for (int col = 0; col < GLYPH_SIZE; ++col) {
+				std::uint8_t pixval = (bits[row] & (0x80 >> col)) != 0 ? 0xFF : 0x00;
+				std::memset(tgt, pixval, bytesPerPixel);
+				tgt += bytesPerPixel;
+			}
+		}
+	}
+	return anyRebuilt;
+}
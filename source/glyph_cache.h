@@ -0,0 +1,50 @@
+#pragma once
+
+#include "address_bus.h"
+#include <cstdint>
+#include <vector>
+
+/*
+The 256 8x8 character patterns of a tile display, expanded ahead of time into pixels of
+the display's format so drawing a cell is a copy per row rather than a loop per pixel. A
+glyph is only expanded again after something invalidates its generator bytes, such as a
+write handler over the character generator.
+*/
+class GlyphCache
+{
+public:
+	static const int NUM_GLYPHS = 256;
+	static const int GLYPH_SIZE = 8;
+
+	// Set bits become pixels with every byte 0xFF, clear bits pixels of 0.
+	GlyphCache(int bytesPerPixel);
+
+	/**
+	 * Marks the glyph holding the generator byte at offset from the start of the
+	 * generator as needing to be expanded again.
+	*/
+	void invalidate(std::uint32_t offset) { dirty[(offset / GLYPH_SIZE) % NUM_GLYPHS] = true; }
+
+	void invalidateAll();
+
+	/**
+	 * Expands every invalidated glyph from the generator at address on bus, reading only
+	 * those glyphs' bytes. Returns whether there were any.
+	*/
+	bool update(AddressBus& bus, std::uint32_t address);
+
+	// Whether the last update expanded the glyph again, so cells showing it need redrawing.
+	bool wasRebuilt(std::uint8_t code) const { return rebuilt[code]; }
+
+	// The pixels of a glyph, GLYPH_SIZE rows of rowBytes() each.
+	const std::uint8_t* glyph(std::uint8_t code) const { return pixels.data() + code * glyphBytes; }
+
+	int rowBytes() const { return glyphBytes / GLYPH_SIZE; }
+
+private:
+	int bytesPerPixel;
+	int glyphBytes;
+	std::vector<std::uint8_t> pixels;
+	bool dirty[NUM_GLYPHS];
+	bool rebuilt[NUM_GLYPHS] = {};
+};
@@ -1,13 +1,19 @@
 #include "cpu/m6502.h"
 #include "ram.h"
+#include "memory_arena.h"
+#include <cstring>
 #include <fstream>
 #include <stdexcept>
 #include <iostream>
 #include <iomanip>
+#include <functional>
+#include <vector>
 
 #include "boost/program_options.hpp"
 
+#ifdef SAM_SDL
 #include <SDL.h>
+#endif
 
 #ifdef WIN32
 #include <windows.h>
@@ -18,6 +24,15 @@ using namespace std;
 #include "rom_loader.h"
 #include "direct_address_bus.h"
 #include "debug_info.h"
+#include "scheduler.h"
+#include "glyph_cache.h"
+#include "dirty_bitmap.h"
+#include "sprite_layer.h"
+#include "collision_detector.h"
+#include "frame_buffer.h"
+
+// The cpu talks to the concrete bus so its memory accesses are not virtual calls.
+typedef m6502Core<DirectAddressBus> SidetracCpu;
 
 struct CLOptions
 {
@@ -26,6 +41,9 @@ struct CLOptions
 	bool errorReported;
 	bool allDone;
 	bool dump;
+	bool headless;
+	bool hash;
+	int frames;
 	std::string rombase;
 	std::string configbase;
 };
@@ -48,6 +66,9 @@ static CLOptions parseCommandLineOptions(int argc, char *argv[])
 	desc.add_options()
 	("help,h", "Print help messages")
 	("dump,d", "Dump disassembly")
+	("headless", "Run without a window")
+	("frames", po::value<int>()->default_value(600), "Frames to run headless")
+	("hash", "Print a hash of the last frame after running headless")
 	("rombase", po::value<string>()->default_value(romBase), "Rom Base Directory")
 	("configbase", po::value<string>()->default_value(configBase), "Config Base Directory");
 	po::variables_map vm;
@@ -66,6 +87,13 @@ static CLOptions parseCommandLineOptions(int argc, char *argv[])
 		retval.rombase = vm["rombase"].as<std::string>();
 		retval.configbase = vm["configbase"].as<std::string>();
 		retval.dump = vm.count("dump");
+		retval.frames = vm["frames"].as<int>();
+		retval.hash = vm.count("hash") != 0;
+#ifdef SAM_SDL
+		retval.headless = vm.count("headless") != 0;
+#else
+		retval.headless = true;
+#endif
 		po::notify(vm);
 	}
 	catch (boost::program_options::required_option &e)
@@ -88,9 +116,9 @@ static CLOptions parseCommandLineOptions(int argc, char *argv[])
 	return retval;
 }
 
-void dump(std::ostream& os, int fromPC, int toPC, DebugInfo& debugInfo, m6502& cpu, AddressBus& bus)
+void dump(std::ostream& os, int fromPC, int toPC, DebugInfo& debugInfo, SidetracCpu& cpu, AddressBus& bus)
 {
-	auto irq_vec = bus.readByte(0x3FFF) * 256 + bus.readByte(0x3FFE);
+	auto irq_vec = bus.readWord(0x3FFE);
 
 	os << "Initial PC: 0x" << std::setw(4) << std::setfill('0') << std::hex << fromPC << std::endl;
 	os << "IRQ vector: 0x" << std::setw(4) << std::setfill('0') << std::hex << irq_vec << std::endl;
@@ -132,43 +160,83 @@ void dump(std::ostream& os, int fromPC, int toPC, DebugInfo& debugInfo, m6502& c
 	}
 }
 
-void renderCharacter(SDL_Surface* surface, int charX, int charY, std::uint8_t code, AddressBus& bus)
+void renderCharacter(FrameBuffer& frame, int charX, int charY, const GlyphCache& glyphs, std::uint8_t code)
 {
-    SDL_PixelFormat* fmt = surface->format;
-    const int bytesPP = fmt->BytesPerPixel;
-    int charBitsAddr = 0x4800 + code * 8;
+    const std::uint8_t* src = glyphs.glyph(code);
+    const int rowBytes = glyphs.rowBytes();
+    std::uint8_t* tgt = frame.row(charY*8) + charX*rowBytes;
     for (int row=0; row<8; ++row){
-        int rowBits = bus.readByte(charBitsAddr);
-        std::uint8_t* tgt = ((std::uint8_t*)surface->pixels) + (charY*8+row)*surface->pitch + (charX*8*bytesPP);
-        for (int col=0; col<8; ++col){
-            rowBits <<= 1;
-            std::uint8_t pixval = 0;
-            if ((rowBits & 0x100) == 0x100){
-                pixval=0xFF;
-            }
-            for (int cc=0; cc<bytesPP; ++cc){
-                *tgt = pixval;
-                ++tgt;
-            }
-        }
-        ++charBitsAddr;
+        memcpy(tgt, src, rowBytes);
+        src += rowBytes;
+        tgt += frame.pitch();
     }
 }
 
-void grabScreenBuffer(SDL_Surface* surface,  AddressBus& bus, Ram& spriteRom)
+// Redraws the cells marked in dirtyCells, those showing a glyph that has changed and those
+// the sprites cover or have left, and adds a rect per run of redrawn cells in a row to rects.
+void grabScreenBuffer(FrameBuffer& frame,  AddressBus& bus, GlyphCache& glyphs, SpriteLayer& sprites, DirtyBitmap& dirtyCells, std::vector<FrameBuffer::Rect>& rects)
 {
     // Video ram (bitmap for characters) is at 0x4800
     // Character ram is at 0x4000
-    SDL_LockSurface(surface);
-    int pChar = 0x4000;
+    std::uint8_t charCodes[0x400];
+    bus.readBlock(0x4000, charCodes, sizeof(charCodes));
+    if (glyphs.update(bus, 0x4800)){
+        for (int pChar = 0; pChar < 0x400; ++pChar){
+            if (glyphs.wasRebuilt(charCodes[pChar])){
+                dirtyCells.mark(pChar);
+            }
+        }
+    }
+    bool drawSprites = sprites.markCells(dirtyCells);
+    if (!dirtyCells.any()){
+        return;
+    }
+
     for (int charY = 0; charY < 0x20; ++charY){
-        for (int charX = 0; charX < 0x20; ++charX){
-            std::uint8_t charCode = bus.readByte(pChar);
-            renderCharacter(surface, charX, charY, charCode, bus);
-            ++pChar;
+        int runStart = -1;
+        // One past the end of the row closes the last run.
+        for (int charX = 0; charX <= 0x20; ++charX){
+            int pChar = charY * 0x20 + charX;
+            if (charX < 0x20 && dirtyCells.test(pChar)){
+                renderCharacter(frame, charX, charY, glyphs, charCodes[pChar]);
+                if (runStart < 0){
+                    runStart = charX;
+                }
+            }
+            else if (runStart >= 0){
+                rects.push_back(FrameBuffer::Rect{ runStart * 8, charY * 8, (charX - runStart) * 8, 8 });
+                runStart = -1;
+            }
+        }
+    }
+    if (drawSprites){
+        sprites.draw(frame.pixels(), frame.pitch());
+    }
+    dirtyCells.clear();
+}
+
+// Checks the frame just drawn for collisions and schedules each one to be latched into
+// the interrupt latch at 0x5103 when the beam reaches its first pixel in the frame starting
+// at frameStart.
+void scheduleCollisions(Scheduler& scheduler, std::int64_t frameStart, const CollisionDetector& collisions, const SpriteLayer& sprites, AddressBus& bus)
+{
+    std::uint8_t charCodes[0x400];
+    std::uint8_t charBits[0x800];
+    bus.readBlock(0x4000, charCodes, sizeof(charCodes));
+    bus.readBlock(0x4800, charBits, sizeof(charBits));
+
+    CollisionDetector::Collision found[CollisionDetector::NUM_COLLISIONS];
+    if (collisions.check(sprites, charCodes, charBits, found) == 0){
+        return;
+    }
+    for (int collision = 0; collision < CollisionDetector::NUM_COLLISIONS; ++collision){
+        if (found[collision].hit){
+            // Frames start at vblank, 0x18 lines of 0x150 pixels before the first visible line.
+            std::int64_t pixel = (0x18 + found[collision].y) * 0x150 + found[collision].x;
+            std::uint8_t bit = CollisionDetector::statusBit(collision);
+            scheduler.schedule(frameStart + pixel / 8, [&bus, bit](std::int64_t) { bus.setByte(0x5103, bus.readByte(0x5103) | bit); });
         }
     }
-    SDL_UnlockSurface(surface);
 }
 
 /*
@@ -196,6 +264,22 @@ Rate = 59 Frames per second
 
 static const int MILLIS_PER_FRAME = 1000 / 59;
 
+// Runs the cpu for a frame and draws it into the frame buffer.
+typedef std::function<void()> FrameRunner;
+
+// Makes frames as fast as possible. printHash prints a hash of the last one, so runs can be compared.
+int runHeadless(int frames, bool printHash, const FrameBuffer& frame, const FrameRunner& runFrame)
+{
+	for (int frameNum = 0; frameNum < frames; ++frameNum) {
+		runFrame();
+	}
+	if (printHash) {
+		std::cout << "frames: " << std::dec << frames << " hash: " << std::hex << std::setw(16) << std::setfill('0') << frame.hash() << std::endl;
+	}
+	return 0;
+}
+
+#ifdef SAM_SDL
 static const auto COIN1_KEY = SDLK_1;
 static const auto START1_KEY = SDLK_2;
 static const auto START2_KEY = SDLK_3;
@@ -204,7 +288,9 @@ static const auto DOWN_KEY = SDLK_DOWN;
 static const auto LEFT_KEY = SDLK_LEFT;
 static const auto RIGHT_KEY = SDLK_RIGHT;
 
-int runCpu(DebugInfo& debugInfo, m6502& cpu, AddressBus& bus, Ram& graphicsRam)
+// Shows frames in a window at the game's speed. Only the parts of the frame in changed are
+// copied to the window.
+int runWindowed(FrameBuffer& frame, const std::vector<FrameBuffer::Rect>& changed, DirtyBitmap& dirtyCells, std::uint8_t& inputPort, const FrameRunner& runFrame)
 {
     if (SDL_Init(SDL_INIT_VIDEO) < 0){
         std::cout << "SDL init fail: " << SDL_GetError();
@@ -215,27 +301,32 @@ int runCpu(DebugInfo& debugInfo, m6502& cpu, AddressBus& bus, Ram& graphicsRam)
         std::cout << "SDL create window fail: " << SDL_GetError();
         return -1;
     }
-    SDL_Surface* surface = SDL_GetWindowSurface( window );
-    
-	// There are 8 pixels per cpu cycle
-	// There are 94080 pixels per frame and so there are 11,760 cycles per frame
-	const int cyclesPerFrame = 11760;
-
-	// Input port - active low
-	bus.writeByte(0x5101, 0xFF);
+    // SDL converts from the frame buffer's format to the window's as it copies.
+    Uint32 frameFormat = frame.format() == FrameBuffer::Format::ARGB32 ? SDL_PIXELFORMAT_ARGB8888 : SDL_PIXELFORMAT_RGB332;
+    SDL_Surface* frameSurface = SDL_CreateRGBSurfaceWithFormatFrom(frame.pixels(), frame.width(), frame.height(), frame.bytesPerPixel() * 8, frame.pitch(), frameFormat);
+    if (frameSurface == nullptr){
+        std::cout << "SDL create surface fail: " << SDL_GetError();
+        return -1;
+    }
+    // Black glyph pixels have an alpha of 0, so blending would leave what was there before.
+    SDL_SetSurfaceBlendMode(frameSurface, SDL_BLENDMODE_NONE);
+    std::vector<SDL_Rect> windowRects;
 
 	int frameNum = 1;
 	bool quitRequested = false;
 	unsigned int frame0Tick = SDL_GetTicks();
 	while (!quitRequested) {
-		cpu.cycleCount = 0;
-		while (cpu.cycleCount < cyclesPerFrame) {
-			cpu.step();
-			cpu.setIrqHigh();
-		}
-		cpu.setIrqLow();
-        grabScreenBuffer(surface, bus, graphicsRam);
-        SDL_UpdateWindowSurface( window );
+		runFrame();
+        SDL_Surface* surface = SDL_GetWindowSurface( window );
+        windowRects.clear();
+        for (const auto& rect : changed){
+            SDL_Rect windowRect{ rect.x, rect.y, rect.w, rect.h };
+            SDL_BlitSurface(frameSurface, &windowRect, surface, &windowRect);
+            windowRects.push_back(windowRect);
+        }
+        if (!windowRects.empty()){
+            SDL_UpdateWindowSurfaceRects( window, windowRects.data(), static_cast<int>(windowRects.size()) );
+        }
         
 		unsigned int requiredTick = frame0Tick + frameNum * 1000 / 60;
 
@@ -245,50 +336,42 @@ int runCpu(DebugInfo& debugInfo, m6502& cpu, AddressBus& bus, Ram& graphicsRam)
 			if (event.type == SDL_QUIT) {
 				quitRequested = true;
 			}
+			else if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_EXPOSED) {
+				// The window needs all of it pushing again.
+				dirtyCells.markAll();
+			}
 			else if (event.type == SDL_KEYDOWN) {
 				if (event.key.keysym.sym == COIN1_KEY) {
-					auto val = bus.readByte(0x5101);
-					bus.setByte(0x5101, val & ~0x80);
+					inputPort &= ~0x80;
 				} else if (event.key.keysym.sym == START1_KEY) {
-					auto val = bus.readByte(0x5101);
-					bus.setByte(0x5101, val & ~0x01);
+					inputPort &= ~0x01;
 				} else if (event.key.keysym.sym == UP_KEY) {
-					auto val = bus.readByte(0x5101);
-					bus.setByte(0x5101, val & ~0x20);
+					inputPort &= ~0x20;
 				} else if (event.key.keysym.sym == DOWN_KEY) {
-					auto val = bus.readByte(0x5101);
-					bus.setByte(0x5101, val & ~0x40);
+					inputPort &= ~0x40;
 				} else if (event.key.keysym.sym == LEFT_KEY) {
-					auto val = bus.readByte(0x5101);
-					bus.setByte(0x5101, val & ~0x08);
+					inputPort &= ~0x08;
 				} else if (event.key.keysym.sym == RIGHT_KEY) {
-					auto val = bus.readByte(0x5101);
-					bus.setByte(0x5101, val & ~0x04);
+					inputPort &= ~0x04;
 				}
 			}
 			else if (event.type == SDL_KEYUP) {
 				if (event.key.keysym.sym == COIN1_KEY) {
-					auto val = bus.readByte(0x5101);
-					bus.setByte(0x5101, val | 0x80);
+					inputPort |= 0x80;
 				} else if (event.key.keysym.sym == START1_KEY) {
-					auto val = bus.readByte(0x5101);
-					bus.setByte(0x5101, val | 0x01);
+					inputPort |= 0x01;
 				}
 				else if (event.key.keysym.sym == UP_KEY) {
-					auto val = bus.readByte(0x5101);
-					bus.setByte(0x5101, val | 0x20);
+					inputPort |= 0x20;
 				}
 				else if (event.key.keysym.sym == DOWN_KEY) {
-					auto val = bus.readByte(0x5101);
-					bus.setByte(0x5101, val | 0x40);
+					inputPort |= 0x40;
 				}
 				else if (event.key.keysym.sym == LEFT_KEY) {
-					auto val = bus.readByte(0x5101);
-					bus.setByte(0x5101, val | 0x08);
+					inputPort |= 0x08;
 				}
 				else if (event.key.keysym.sym == RIGHT_KEY) {
-					auto val = bus.readByte(0x5101);
-					bus.setByte(0x5101, val | 0x04);
+					inputPort |= 0x04;
 				}
 			}
 			unsigned int nowTick = SDL_GetTicks();
@@ -310,14 +393,104 @@ int runCpu(DebugInfo& debugInfo, m6502& cpu, AddressBus& bus, Ram& graphicsRam)
 		}
 		++frameNum;
 	}
+    SDL_FreeSurface(frameSurface);
     SDL_DestroyWindow( window );
     SDL_Quit();
 	return 0;
 }
+#endif
+
+int runCpu(DebugInfo& debugInfo, SidetracCpu& cpu, DirectAddressBus& bus, Ram& graphicsRam, const CLOptions& options)
+{
+	FrameBuffer frame(256, 256, FrameBuffer::Format::ARGB32);
+
+	// Glyphs are expanded again only when the game writes to their generator bytes. The
+	// lower half of the generator, 0x4800-0x4BFF, is ROM and never changes.
+	GlyphCache glyphs(frame.bytesPerPixel());
+	for (std::uint32_t charAddr = 0x4C00; charAddr <= 0x4FFF; ++charAddr) {
+		bus.addWriteHandler(charAddr, [&bus, &glyphs](std::uint32_t addr, std::uint8_t val) {
+			bus.setByte(addr, val);
+			glyphs.invalidate(addr - 0x4800);
+		});
+	}
+
+	// The sprite registers are write only and held by the sprite layer. The low 6 address
+	// bits are not decoded.
+	SpriteLayer sprites(graphicsRam.bytes.data(), static_cast<std::uint32_t>(graphicsRam.bytes.size()), frame.bytesPerPixel());
+	sprites.setColour(0, frame.mapRGB(0xFF, 0xFF, 0xFF));
+	sprites.setColour(1, frame.mapRGB(0xFF, 0xFF, 0xFF));
+	for (std::uint32_t spriteAddr = 0x5000; spriteAddr <= 0x50FF; ++spriteAddr) {
+		bus.addWriteHandler(spriteAddr, [&sprites](std::uint32_t addr, std::uint8_t val) {
+			int sprite = (addr >> 7) & 0x01;
+			if ((addr & 0x40) == 0) {
+				sprites.writeXPos(sprite, val);
+			}
+			else {
+				sprites.writeYPos(sprite, val);
+			}
+		});
+	}
+	bus.addWriteHandler(0x5100, [&sprites](std::uint32_t, std::uint8_t val) { sprites.writeSpriteNo(val); });
+	bus.addWriteHandler(0x5101, [&sprites](std::uint32_t, std::uint8_t val) { sprites.writeEnable(val); });
+
+	// Only cells whose codes are written are drawn again.
+	DirtyBitmap dirtyCells(0x400);
+	for (std::uint32_t codeAddr = 0x4000; codeAddr <= 0x43FF; ++codeAddr) {
+		bus.addWriteHandler(codeAddr, [&bus, &dirtyCells](std::uint32_t addr, std::uint8_t val) {
+			bus.setByte(addr, val);
+			dirtyCells.mark(addr - 0x4000);
+		});
+	}
+    
+	// There are 8 pixels per cpu cycle
+	// There are 94080 pixels per frame and so there are 11,760 cycles per frame
+	const int cyclesPerFrame = 11760;
+
+	// Input port - active low, read when the cpu reads it.
+	std::uint8_t inputPort = 0xFF;
+	bus.addReadHandler(0x5101, [&](std::uint32_t) { return inputPort; });
+
+	// The interrupt latch. Collisions are latched as the beam reaches them and cleared at
+	// vblank. The scheduled events write it with setByte and it is read as plain memory,
+	// so a loop polling it can still be skipped up to the next event.
+	CollisionDetector collisions(graphicsRam.bytes.data(), static_cast<std::uint32_t>(graphicsRam.bytes.size()));
+	bus.setByte(0x5103, 0);
+	bus.addWriteHandler(0x5103, [](std::uint32_t, std::uint8_t) {});
+
+	// The vblank irq starts each frame and the line is only held low for its first instruction.
+	Scheduler scheduler;
+	Scheduler::Handler vblank = [&](std::int64_t time) {
+		bus.setByte(0x5103, 0);
+		cpu.setIrqLow();
+		scheduler.schedule(time + 1, [&](std::int64_t) { cpu.setIrqHigh(); });
+		scheduler.schedule(time + cyclesPerFrame, vblank);
+	};
+	scheduler.schedule(0, vblank);
+
+	cpu.cycleCount = 0;
+	std::int64_t frameEnd = 0;
+	std::vector<FrameBuffer::Rect> changed;
+	FrameRunner runFrame = [&]() {
+		frameEnd += cyclesPerFrame;
+		cpu.runUntil(scheduler, frameEnd);
+		changed.clear();
+		grabScreenBuffer(frame, bus, glyphs, sprites, dirtyCells, changed);
+		scheduleCollisions(scheduler, frameEnd, collisions, sprites, bus);
+	};
+
+#ifdef SAM_SDL
+	if (!options.headless) {
+		return runWindowed(frame, changed, dirtyCells, inputPort, runFrame);
+	}
+#endif
+	return runHeadless(options.frames, options.hash, frame, runFrame);
+}
 
 int main(int argc, char *argv[])
 {
-	Ram ram(64 * 1024);
+	// Main memory and the sprite ROM, side by side in one allocation.
+	MemoryArena memory({ { "main", 64 * 1024 }, { "sprites", 0x200 } });
+	Ram& ram = memory.region("main");
 
 	CLOptions options = parseCommandLineOptions(argc, argv);
 	if (options.allDone)
@@ -329,37 +502,43 @@ int main(int argc, char *argv[])
 		return -1;
 	}
 
+	// The program and character ROMs are mapped onto the bus in place.
 	RomLoader romLoader(options.rombase + "/sidetrac");
-	romLoader.load("stl8a-1", 0x2800, 0x0800, ram);
-	romLoader.load("stl7a-2", 0x3000, 0x0800, ram);
-	romLoader.load("stl6a-2", 0x3800, 0x0800, ram);
-	romLoader.load("stl9c-1", 0x4800, 0x0400, ram);
+	MappedRom programRom1 = romLoader.map("stl8a-1", 0x0800);
+	MappedRom programRom2 = romLoader.map("stl7a-2", 0x0800);
+	MappedRom programRom3 = romLoader.map("stl6a-2", 0x0800);
+	MappedRom characterRom = romLoader.map("stl9c-1", 0x0400);
 
     // Sprites
-    Ram graphicsRam(0x200);
+    Ram& graphicsRam = memory.region("sprites");
     romLoader.load("stl11d", 0x0, 0x0200, graphicsRam);
     
 	DirectAddressBus bus(ram);
+	bus.mapRom(0x2800, programRom1.data(), 0x0800);
+	bus.mapRom(0x3000, programRom2.data(), 0x0800);
+	bus.mapRom(0x3800, programRom3.data(), 0x0800);
+	bus.mapRom(0x4800, characterRom.data(), 0x0400);
 
-	m6502 cpu(bus);
+	SidetracCpu cpu(bus);
 
 	DebugInfo debugInfo;
 	debugInfo.read(options.configbase + "/sidetrac_symbols.json");
 
-	// dip switches. Set before the write handler is installed.
+	// dip switches. Writes to 0x5100 set the sprite numbers instead.
 	bus.writeByte(0x5100, 0);
 
-	bus.addWriteHandler(0x5100, [](std::uint32_t addr, std::uint8_t val) {/* std::cout << "wrote " << (int)val << " to 5100" << endl; */ });
-
 	// 0x3f00 is mirrored to 0xFF00
 	bus.setMirror(0xFF00, 0xFFFF, 0x3F00);
+
+	// The program ROMs.
+	cpu.enableCodeCache(0x2800, 0x3FFF);
 	cpu.reset();
 
 	auto pc = cpu.regPC;
 	if (options.dump) {
 		dump(std::cout, pc, 0x3aaa, debugInfo, cpu, bus);
 	}
-	return runCpu(debugInfo, cpu, bus, graphicsRam);
+	return runCpu(debugInfo, cpu, bus, graphicsRam, options);
 }
 /*
 ROM_START(sidetrac)
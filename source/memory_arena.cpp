@@ -0,0 +1,37 @@
+#include "memory_arena.h"
+#include <cstdlib>
+#include <new>
+#include <stdexcept>
+
+static std::size_t roundUpToPage(std::size_t size)
+{
+	return (size + MemoryArena::PAGE_SIZE - 1) & ~(MemoryArena::PAGE_SIZE - 1);
+}
+
+MemoryArena::MemoryArena(const std::vector<RegionDesc>& regionDescs)
+{
+	for (const auto& desc : regionDescs) {
+		totalSize += roundUpToPage(desc.size);
+	}
+
+	// calloc lets the system hand out zero pages lazily; the extra page is for alignment.
+	allocation = std::calloc(totalSize + PAGE_SIZE, 1);
+	if (allocation == nullptr) {
+		throw std::bad_alloc();
+	}
+	base = reinterpret_cast<std::uint8_t*>(roundUpToPage(reinterpret_cast<std::uintptr_t>(allocation)));
+
+	std::size_t offset = 0;
+	for (const auto& desc : regionDescs) {
+		if (!regions.emplace(desc.name, Ram(base + offset, desc.size)).second) {
+			std::free(allocation);
+			throw std::invalid_argument("memory arena region names must be unique");
+		}
+		offset += roundUpToPage(desc.size);
+	}
+}
+
+MemoryArena::~MemoryArena()
+{
+	std::free(allocation);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "ram.h"
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+/*
+All the RAM and ROM of a machine in one zeroed, contiguous allocation, split into named
+regions. Each region starts on a host page boundary. Snapshots, hashing and dirty tracking
+can work on the whole arena as one span, and regions used together sit side by side.
+*/
+class MemoryArena
+{
+public:
+	class RegionDesc
+	{
+	public:
+		std::string name;
+		std::uint32_t size;
+	};
+
+	static const std::size_t PAGE_SIZE = 4096;
+
+	MemoryArena(const std::vector<RegionDesc>& regionDescs);
+	~MemoryArena();
+
+	MemoryArena(const MemoryArena&) = delete;
+	MemoryArena& operator=(const MemoryArena&) = delete;
+
+	/**
+	 * The region called name. Throws std::out_of_range if there isn't one.
+	*/
+	Ram& region(const std::string& name) { return regions.at(name); }
+
+	// The whole arena, including the padding between regions.
+	ByteSpan bytes() const { return ByteSpan(base, totalSize); }
+
+private:
+	void* allocation = nullptr;
+	std::uint8_t* base = nullptr;
+	std::size_t totalSize = 0;
+	std::map<std::string, Ram> regions;
+};
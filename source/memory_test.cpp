@@ -0,0 +1,86 @@
+#define BOOST_TEST_MODULE memory_test
+#include <boost/test/included/unit_test.hpp>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+#include "ram.h"
+#include "memory_arena.h"
+#include "direct_address_bus.h"
+#include "rom_loader.h"
+
+BOOST_AUTO_TEST_CASE(test_memory_arena)
+{
+	MemoryArena memory({ { "main", 64 * 1024 }, { "sprites", 0x200 }, { "colour", 0x20 } });
+	Ram& main = memory.region("main");
+	Ram& sprites = memory.region("sprites");
+	Ram& colour = memory.region("colour");
+
+	// Regions follow each other in one allocation, each starting on a host page.
+	BOOST_CHECK_EQUAL(main.bytes.size(), 64 * 1024);
+	BOOST_CHECK_EQUAL(sprites.bytes.size(), 0x200);
+	BOOST_CHECK(main.bytes.data() == memory.bytes().data());
+	BOOST_CHECK(sprites.bytes.data() == main.bytes.data() + 64 * 1024);
+	BOOST_CHECK(colour.bytes.data() == sprites.bytes.data() + MemoryArena::PAGE_SIZE);
+	BOOST_CHECK_EQUAL(reinterpret_cast<std::uintptr_t>(memory.bytes().data()) % MemoryArena::PAGE_SIZE, 0);
+	BOOST_CHECK_EQUAL(memory.bytes().size(), 64 * 1024 + 2 * MemoryArena::PAGE_SIZE);
+
+	// The arena starts zeroed and a region is a view of it.
+	bool zeroed = true;
+	for (auto byte : memory.bytes()) {
+		zeroed = zeroed && byte == 0;
+	}
+	BOOST_CHECK(zeroed);
+	sprites.bytes[0x10] = 0x5A;
+	BOOST_CHECK_EQUAL(memory.bytes()[64 * 1024 + 0x10], 0x5A);
+
+	// A bus works over a region just as over a Ram of its own.
+	DirectAddressBus bus(main);
+	bus.writeByte(0x1234, 0x77);
+	BOOST_CHECK_EQUAL(main.bytes[0x1234], 0x77);
+
+	BOOST_CHECK_THROW(memory.region("missing"), std::out_of_range);
+}
+
+BOOST_AUTO_TEST_CASE(test_mapped_rom)
+{
+	{
+		std::ofstream romFile("memory_test_rom.bin", std::ios::binary);
+		for (int i = 0; i < 0x200; ++i) {
+			romFile.put(static_cast<char>(i ^ 0x5A));
+		}
+	}
+
+	RomLoader romLoader(".");
+	MappedRom rom = romLoader.map("memory_test_rom.bin", 0x200);
+	BOOST_CHECK_EQUAL(rom.size(), 0x200);
+	BOOST_CHECK_EQUAL(rom.data()[0x123], 0x23 ^ 0x5A);
+
+	Ram ram(64 * 1024);
+	DirectAddressBus bus(ram);
+	bus.mapRom(0x3E00, rom.data(), 0x200);
+	bus.setMirror(0xFF00, 0xFFFF, 0x3F00);
+
+	// Reads come from the file, through mirrors too, and writes are dropped.
+	BOOST_CHECK_EQUAL(bus.readByte(0x3E00), 0x5A);
+	BOOST_CHECK_EQUAL(bus.readWord(0xFFFC), ((0xFC ^ 0x5A) | ((0xFD ^ 0x5A) << 8)));
+	bus.writeByte(0x3E10, 0x00);
+	bus.writeByte(0xFF10, 0x00);
+	BOOST_CHECK_EQUAL(bus.readByte(0x3E10), 0x10 ^ 0x5A);
+	BOOST_CHECK_EQUAL(bus.readByte(0xFF10), 0x10 ^ 0x5A);
+	BOOST_CHECK_EQUAL(ram.bytes[0x3E10], 0);
+	BOOST_CHECK(bus.plainMemoryPage(0x3E) == nullptr);
+
+	// Block reads run across ROM pages.
+	std::uint8_t block[4];
+	bus.readBlock(0x3EFE, block, 4);
+	BOOST_CHECK_EQUAL(block[1], 0xFF ^ 0x5A);
+	BOOST_CHECK_EQUAL(block[2], 0x00 ^ 0x5A);
+
+	BOOST_CHECK_THROW(bus.mapRom(0x4010, rom.data(), 0x100), std::invalid_argument);
+	BOOST_CHECK_THROW(romLoader.map("memory_test_rom.bin", 0x400), std::length_error);
+	BOOST_CHECK_THROW(romLoader.map("missing_rom.bin", 0x100), std::runtime_error);
+
+	std::remove("memory_test_rom.bin");
+}
@@ -1,5 +1,10 @@
 #include "ram.h"
 
-Ram::Ram(int sizeIn) : bytes(sizeIn)
+Ram::Ram(int sizeIn) : bytes(nullptr, sizeIn), owned(new std::uint8_t[sizeIn]())
+{
+	bytes = ByteSpan(owned.get(), sizeIn);
+}
+
+Ram::Ram(std::uint8_t* data, int sizeIn) : bytes(data, sizeIn)
 {
 }
@@ -1,11 +1,39 @@
 #pragma once
 
-#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/*
+A run of bytes owned elsewhere, indexed like the vector Ram used to hold.
+*/
+class ByteSpan
+{
+public:
+	ByteSpan(std::uint8_t* dataIn, std::size_t sizeIn) : first(dataIn), count(sizeIn) {}
+
+	std::uint8_t& operator[](std::size_t index) const { return first[index]; }
+	std::uint8_t* data() const { return first; }
+	std::size_t size() const { return count; }
+	std::uint8_t* begin() const { return first; }
+	std::uint8_t* end() const { return first + count; }
+
+private:
+	std::uint8_t* first;
+	std::size_t count;
+};
 
 class Ram
 {
 public:
+	// Zeroed memory of its own.
 	Ram(int size);
 
-	std::vector<unsigned char> bytes;
+	// A view of memory owned by something else, such as a MemoryArena region.
+	Ram(std::uint8_t* data, int size);
+
+	ByteSpan bytes;
+
+private:
+	std::unique_ptr<std::uint8_t[]> owned;
 };
@@ -2,6 +2,14 @@
 #include "ram.h"
 #include <fstream>
 #include <stdexcept>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 void RomLoader::load(std::string filename, int startAddr, int bytesToLoad, Ram& ram)
 {
@@ -20,3 +28,81 @@ void RomLoader::load(std::string filename, int startAddr, int bytesToLoad, Ram&
 		throw std::runtime_error("failed to open ROM file");
 	}
 }
+
+MappedRom RomLoader::map(std::string filename, int bytesToMap)
+{
+	return MappedRom(base + '/' + filename, bytesToMap);
+}
+
+#if defined(_WIN32)
+
+MappedRom::MappedRom(const std::string& path, std::size_t lengthIn)
+{
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("failed to open ROM file");
+	}
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart < static_cast<LONGLONG>(lengthIn)) {
+		CloseHandle(file);
+		throw std::length_error("ROM file is too short");
+	}
+	HANDLE fileMapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	CloseHandle(file);
+	if (fileMapping == nullptr) {
+		throw std::runtime_error("failed to map ROM file");
+	}
+	// The view keeps the file mapping open.
+	void* view = MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, lengthIn);
+	CloseHandle(fileMapping);
+	if (view == nullptr) {
+		throw std::runtime_error("failed to map ROM file");
+	}
+	mapping = static_cast<const std::uint8_t*>(view);
+	length = lengthIn;
+}
+
+MappedRom::~MappedRom()
+{
+	if (mapping != nullptr) {
+		UnmapViewOfFile(mapping);
+	}
+}
+
+#else
+
+MappedRom::MappedRom(const std::string& path, std::size_t lengthIn)
+{
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw std::runtime_error("failed to open ROM file");
+	}
+	struct stat fileStat;
+	if (fstat(fd, &fileStat) != 0 || fileStat.st_size < static_cast<off_t>(lengthIn)) {
+		close(fd);
+		throw std::length_error("ROM file is too short");
+	}
+	// Read only and shared, so every process mapping the file uses the same page cache pages.
+	void* view = mmap(nullptr, lengthIn, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (view == MAP_FAILED) {
+		throw std::runtime_error("failed to map ROM file");
+	}
+	mapping = static_cast<const std::uint8_t*>(view);
+	length = lengthIn;
+}
+
+MappedRom::~MappedRom()
+{
+	if (mapping != nullptr) {
+		munmap(const_cast<std::uint8_t*>(mapping), length);
+	}
+}
+
+#endif
+
+MappedRom::MappedRom(MappedRom&& other) : mapping(other.mapping), length(other.length)
+{
+	other.mapping = nullptr;
+	other.length = 0;
+}
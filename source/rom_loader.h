@@ -1,7 +1,31 @@
 #pragma once
+#include <cstddef>
+#include <cstdint>
 #include <string>
 class Ram;
 
+/*
+A ROM image mapped read-only straight from its file, with no copy. Machines that map the
+same file share its physical pages, and a stray write faults rather than changing the image.
+*/
+class MappedRom
+{
+public:
+	MappedRom(const std::string& path, std::size_t length);
+	~MappedRom();
+
+	MappedRom(MappedRom&& other);
+	MappedRom(const MappedRom&) = delete;
+	MappedRom& operator=(const MappedRom&) = delete;
+
+	const std::uint8_t* data() const { return mapping; }
+	std::size_t size() const { return length; }
+
+private:
+	const std::uint8_t* mapping = nullptr;
+	std::size_t length = 0;
+};
+
 /*
 Loads ROM images into memory.
 */
@@ -12,6 +36,11 @@ public:
 
 	void load(std::string filename, int startAddr, int bytesToLoad, Ram& ram);
 
+	/**
+	 * Maps the first bytesToMap bytes of filename, for DirectAddressBus::mapRom.
+	*/
+	MappedRom map(std::string filename, int bytesToMap);
+
 private:
 	std::string base;
 };
@@ -0,0 +1,22 @@
+#include "scheduler.h"
+#include <limits>
+
+void Scheduler::schedule(std::int64_t time, Handler handler)
+{
+	events.push(Event{ time, nextSequence++, std::move(handler) });
+}
+
+std::int64_t Scheduler::nextEventTime() const
+{
+	return events.empty() ? std::numeric_limits<std::int64_t>::max() : events.top().time;
+}
+
+void Scheduler::runEvents(std::int64_t now)
+{
+	while (!events.empty() && events.top().time <= now) {
+		// The handler may schedule more events, so take it off the queue first.
+		Event event = events.top();
+		events.pop();
+		event.handler(event.time);
+	}
+}
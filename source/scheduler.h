@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <vector>
+
+/*
+A timeline of device events, such as the vblank irq, timers and input sampling, in
+emulated cycles. The cpu's cycleCount is the time: a driver runs the cpu up to the next
+event, fires it, and carries on, so interrupt lines change at the cycle they are due
+rather than being polled for.
+*/
+class Scheduler
+{
+public:
+	// Called with the time the event was scheduled for, so a periodic event can add its
+	// period to that and never drift.
+	typedef std::function<void(std::int64_t time)> Handler;
+
+	/**
+	 * Adds an event at time. Events at the same time fire in the order they were added.
+	*/
+	void schedule(std::int64_t time, Handler handler);
+
+	/**
+	 * The time of the earliest event, or the largest std::int64_t if there is none.
+	*/
+	std::int64_t nextEventTime() const;
+
+	/**
+	 * Fires, in order, every event due at or before now, including any that the handlers
+	 * schedule at or before now.
+	*/
+	void runEvents(std::int64_t now);
+
+private:
+	class Event
+	{
+	public:
+		std::int64_t time;
+		std::uint64_t sequence;
+		Handler handler;
+	};
+
+	class Later
+	{
+	public:
+		bool operator()(const Event& lhs, const Event& rhs) const
+		{
+			return lhs.time != rhs.time ? lhs.time > rhs.time : lhs.sequence > rhs.sequence;
+		}
+	};
+
+	std::priority_queue<Event, std::vector<Event>, Later> events;
+	std::uint64_t nextSequence = 0;
+};
@@ -0,0 +1,47 @@
+#define BOOST_TEST_MODULE scheduler_test
+#include <boost/test/included/unit_test.hpp>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "scheduler.h"
+
+BOOST_AUTO_TEST_CASE(test_scheduler)
+{
+	Scheduler scheduler;
+	std::vector<int> fired;
+
+	BOOST_CHECK_EQUAL(scheduler.nextEventTime(), std::numeric_limits<std::int64_t>::max());
+
+	scheduler.schedule(20, [&](std::int64_t) { fired.push_back(3); });
+	scheduler.schedule(10, [&](std::int64_t) { fired.push_back(1); });
+	scheduler.schedule(10, [&](std::int64_t) { fired.push_back(2); });
+	BOOST_CHECK_EQUAL(scheduler.nextEventTime(), 10);
+
+	// Nothing is due yet.
+	scheduler.runEvents(9);
+	BOOST_CHECK(fired.empty());
+
+	// Events at the same time fire in the order they were added.
+	scheduler.runEvents(10);
+	BOOST_CHECK_EQUAL(fired.size(), 2);
+	BOOST_CHECK_EQUAL(fired[0], 1);
+	BOOST_CHECK_EQUAL(fired[1], 2);
+	BOOST_CHECK_EQUAL(scheduler.nextEventTime(), 20);
+
+	// A periodic event is given its own time so it reschedules without drift, and
+	// events it adds that are already due fire in the same call.
+	std::vector<std::int64_t> ticks;
+	Scheduler::Handler tick = [&](std::int64_t time) {
+		ticks.push_back(time);
+		scheduler.schedule(time + 7, tick);
+	};
+	scheduler.schedule(15, tick);
+	scheduler.runEvents(30);
+	BOOST_CHECK_EQUAL(fired.size(), 3);
+	BOOST_CHECK_EQUAL(ticks.size(), 3);
+	BOOST_CHECK_EQUAL(ticks[0], 15);
+	BOOST_CHECK_EQUAL(ticks[1], 22);
+	BOOST_CHECK_EQUAL(ticks[2], 29);
+	BOOST_CHECK_EQUAL(scheduler.nextEventTime(), 36);
+}
@@ -0,0 +1,152 @@
+#include "sprite_layer.h"
+#include <algorithm>
+#include <cstring>
+
+// Calls visit with each cell a sprite at x, y covers until it returns true, and returns
+// whether it did.
+template <class Visitor>
+static bool forEachCell(int x, int y, Visitor visit)
+{
+	const int size = SpriteLayer::SPRITE_SIZE;
+	const int screenSize = SpriteLayer::SCREEN_SIZE;
+	const int cellSize = SpriteLayer::CELL_SIZE;
+	if (x + size <= 0 || y + size <= 0 || x >= screenSize || y >= screenSize) {
+		return false;
+	}
+	int firstX = std::max(0, x) / cellSize;
+	int lastX = std::min(screenSize - 1, x + size - 1) / cellSize;
+	int firstY = std::max(0, y) / cellSize;
+	int lastY = std::min(screenSize - 1, y + size - 1) / cellSize;
+	for (int cellY = firstY; cellY <= lastY; ++cellY) {
+		for (int cellX = firstX; cellX <= lastX; ++cellX) {
+			if (visit(static_cast<std::uint32_t>(cellY * (screenSize / cellSize) + cellX))) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+SpriteLayer::SpriteLayer(const std::uint8_t* rom, std::uint32_t romSize, int bytesPerPixelIn)
+	: bytesPerPixel(bytesPerPixelIn)
+	, numSprites(static_cast<int>(romSize / 32))
+	, masks(numSprites * SPRITE_SIZE * SPRITE_SIZE * bytesPerPixelIn)
+	, colours(NUM_SPRITES * bytesPerPixelIn, 0xFF)
+{
+	std::uint8_t* tgt = masks.data();
+	for (int sprite = 0; sprite < numSprites; ++sprite) {
+		const std::uint8_t* bits = rom + sprite * 32;
+		for (int row = 0; row < SPRITE_SIZE; ++row) {
+			int rowBits = (bits[row] << 8) | bits[row + 16];
+			for (int col = 0; col < SPRITE_SIZE; ++col) {
+				std::uint8_t maskval = (rowBits & (0x8000 >> col)) != 0 ? 0xFF : 0x00;
+				std::memset(tgt, maskval, bytesPerPixel);
+				tgt += bytesPerPixel;
+			}
+		}
+	}
+}
+
+void SpriteLayer::setColour(int sprite, std::uint32_t pixel)
+{
+	// Pixel values are stored in host byte order.
+	std::memcpy(colours.data() + sprite * bytesPerPixel, &pixel, std::min<std::size_t>(bytesPerPixel, sizeof(pixel)));
+}
+
+int SpriteLayer::screenX(int sprite) const
+{
+	return 236 - xpos[sprite] - 4;
+}
+
+int SpriteLayer::screenY(int sprite) const
+{
+	// Sprite 1 can't go above the top of the screen.
+	int y = 244 - ypos[sprite] - 4;
+	return sprite == 0 ? std::max(y, 0) : y;
+}
+
+int SpriteLayer::code(int sprite) const
+{
+	int number = sprite == 0 ? (spriteNo & 0x0F) : (spriteNo >> 4);
+	int bank = (enable >> (5 + sprite)) & 0x01;
+	return numSprites == 0 ? 0 : (number + 16 * bank) % numSprites;
+}
+
+bool SpriteLayer::visible(int sprite) const
+{
+	return sprite != 0 || (enable & 0x80) == 0;
+}
+
+bool SpriteLayer::markCells(DirtyBitmap& cells)
+{
+	if (numSprites == 0) {
+		return false;
+	}
+	bool redraw = changed || !drawn;
+	for (int sprite = 0; sprite < NUM_SPRITES && !redraw; ++sprite) {
+		redraw = visible(sprite) && anyMarked(cells, screenX(sprite), screenY(sprite));
+	}
+	if (!redraw) {
+		return false;
+	}
+	for (int sprite = 0; sprite < NUM_SPRITES; ++sprite) {
+		if (visible(sprite)) {
+			markRect(cells, screenX(sprite), screenY(sprite));
+		}
+		if (drawn && drawnVisible[sprite]) {
+			markRect(cells, drawnX[sprite], drawnY[sprite]);
+		}
+	}
+	return true;
+}
+
+void SpriteLayer::draw(std::uint8_t* pixels, int pitch)
+{
+	if (numSprites == 0) {
+		return;
+	}
+	for (int sprite = NUM_SPRITES - 1; sprite >= 0; --sprite) {
+		if (visible(sprite)) {
+			drawSprite(sprite, pixels, pitch);
+		}
+	}
+	for (int sprite = 0; sprite < NUM_SPRITES; ++sprite) {
+		drawnX[sprite] = screenX(sprite);
+		drawnY[sprite] = screenY(sprite);
+		drawnVisible[sprite] = visible(sprite);
+	}
+	drawn = true;
+	changed = false;
+}
+
+void SpriteLayer::drawSprite(int sprite, std::uint8_t* pixels, int pitch) const
+{
+	int x = screenX(sprite);
+	int y = screenY(sprite);
+	int firstCol = std::max(0, -x);
+	int lastCol = x > SCREEN_SIZE - SPRITE_SIZE ? SCREEN_SIZE - x : SPRITE_SIZE;
+	if (firstCol >= lastCol) {
+		return;
+	}
+	const int rowBytes = SPRITE_SIZE * bytesPerPixel;
+	const int spanBytes = (lastCol - firstCol) * bytesPerPixel;
+	const std::uint8_t* colour = colours.data() + sprite * bytesPerPixel;
+	const std::uint8_t* mask = masks.data() + code(sprite) * SPRITE_SIZE * rowBytes;
+	for (int row = std::max(0, -y); row < SPRITE_SIZE && y + row < SCREEN_SIZE; ++row) {
+		const std::uint8_t* src = mask + row * rowBytes + firstCol * bytesPerPixel;
+		std::uint8_t* tgt = pixels + (y + row) * pitch + (x + firstCol) * bytesPerPixel;
+		for (int i = 0; i < spanBytes; ++i) {
+			tgt[i] = (tgt[i] & ~src[i]) | (colour[i % bytesPerPixel] & src[i]);
+		}
+	}
+}
+
+void SpriteLayer::markRect(DirtyBitmap& cells, int x, int y)
+{
+	forEachCell(x, y, [&cells](std::uint32_t cell) { cells.mark(cell); return false; });
+}
+
+bool SpriteLayer::anyMarked(const DirtyBitmap& cells, int x, int y)
+{
+	return forEachCell(x, y, [&cells](std::uint32_t cell) { return cells.test(cell); });
+}
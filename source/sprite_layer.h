@@ -0,0 +1,79 @@
+#pragma once
+
+#include "dirty_bitmap.h"
+#include <cstdint>
+#include <vector>
+
+/*
+The two 16x16 sprites of an Exidy board, drawn over a 256x256 layer of 8x8 character
+cells. The 1bpp sprite ROM is expanded once into masks in the display's pixel format, so a
+sprite row is drawn by masking in its colour rather than testing bits. The position, number
+and enable registers are written through the port methods, typically from bus write
+handlers, so nothing is read back from the bus to draw a frame.
+*/
+class SpriteLayer
+{
+public:
+	static const int NUM_SPRITES = 2;
+	static const int SPRITE_SIZE = 16;
+	static const int SCREEN_SIZE = 256;
+	static const int CELL_SIZE = 8;
+
+	// rom holds 32 bytes per sprite: the left halves of the 16 rows, then the right halves.
+	SpriteLayer(const std::uint8_t* rom, std::uint32_t romSize, int bytesPerPixel);
+
+	// Sets the pixel value, in the display's format, that sprite is drawn in.
+	void setColour(int sprite, std::uint32_t pixel);
+
+	void writeXPos(int sprite, std::uint8_t val) { xpos[sprite] = val; changed = true; }
+	void writeYPos(int sprite, std::uint8_t val) { ypos[sprite] = val; changed = true; }
+	// The low nibble is sprite 1's number, the high nibble sprite 2's.
+	void writeSpriteNo(std::uint8_t val) { spriteNo = val; changed = true; }
+	// Bits 5 and 6 pick the bank of 16 sprites that sprites 1 and 2 come from, and bit 7
+	// hides sprite 1 when set.
+	void writeEnable(std::uint8_t val) { enable = val; changed = true; }
+
+	// Where sprite is on the screen, which may be partly or wholly off it.
+	int screenX(int sprite) const;
+	int screenY(int sprite) const;
+	// The index into the sprite ROM that sprite shows.
+	int code(int sprite) const;
+	// Whether sprite is shown at all. Only sprite 1 can be turned off.
+	bool visible(int sprite) const;
+
+	/**
+	 * Marks the cells under the sprites, and under where they were last drawn, when the
+	 * sprites have changed or any of those cells is already marked. The sprites must then
+	 * be drawn over the redrawn cells, which this returns.
+	*/
+	bool markCells(DirtyBitmap& cells);
+
+	/**
+	 * Draws sprite 2 and then sprite 1, if they are visible, onto pixels, a SCREEN_SIZE square in the pixel
+	 * format given to the constructor, clipping them to it.
+	*/
+	void draw(std::uint8_t* pixels, int pitch);
+
+private:
+	void drawSprite(int sprite, std::uint8_t* pixels, int pitch) const;
+	static void markRect(DirtyBitmap& cells, int x, int y);
+	static bool anyMarked(const DirtyBitmap& cells, int x, int y);
+
+	int bytesPerPixel;
+	int numSprites;
+	// SPRITE_SIZE rows of SPRITE_SIZE pixels per sprite, 0xFF bytes where the sprite is set.
+	std::vector<std::uint8_t> masks;
+	std::vector<std::uint8_t> colours;
+
+	std::uint8_t xpos[NUM_SPRITES] = {};
+	std::uint8_t ypos[NUM_SPRITES] = {};
+	std::uint8_t spriteNo = 0;
+	std::uint8_t enable = 0;
+	bool changed = true;
+
+	// Where the sprites were last drawn.
+	int drawnX[NUM_SPRITES];
+	int drawnY[NUM_SPRITES];
+	bool drawnVisible[NUM_SPRITES];
+	bool drawn = false;
+};
@@ -0,0 +1,348 @@
+#define BOOST_TEST_MODULE video_test
+#include <boost/test/included/unit_test.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "ram.h"
+#include "direct_address_bus.h"
+#include "glyph_cache.h"
+#include "dirty_bitmap.h"
+#include "sprite_layer.h"
+#include "collision_detector.h"
+#include "frame_buffer.h"
+
+BOOST_AUTO_TEST_CASE(test_glyph_cache)
+{
+	Ram ram(64 * 1024);
+	DirectAddressBus bus(ram);
+
+	// Glyph 1 is a diagonal, glyph 2 has its top row set.
+	for (int row = 0; row < 8; ++row) {
+		ram.bytes[0x4808 + row] = static_cast<std::uint8_t>(0x80 >> row);
+	}
+	ram.bytes[0x4810] = 0xFF;
+
+	GlyphCache glyphs(4);
+	BOOST_CHECK_EQUAL(glyphs.rowBytes(), 32);
+	glyphs.update(bus, 0x4800);
+
+	const std::uint8_t* diagonal = glyphs.glyph(1);
+	for (int row = 0; row < 8; ++row) {
+		for (int col = 0; col < 8; ++col) {
+			std::uint8_t expected = row == col ? 0xFF : 0x00;
+			for (int byte = 0; byte < 4; ++byte) {
+				BOOST_CHECK_EQUAL(diagonal[row * 32 + col * 4 + byte], expected);
+			}
+		}
+	}
+	BOOST_CHECK_EQUAL(glyphs.glyph(2)[31], 0xFF);
+	BOOST_CHECK_EQUAL(glyphs.glyph(2)[32], 0x00);
+
+	// Changed generator bytes only show once their glyph is invalidated.
+	ram.bytes[0x4810] = 0x00;
+	ram.bytes[0x4818] = 0xFF;
+	glyphs.invalidate(0x18);
+	glyphs.update(bus, 0x4800);
+	BOOST_CHECK_EQUAL(glyphs.glyph(2)[0], 0xFF);
+	BOOST_CHECK_EQUAL(glyphs.glyph(3)[0], 0xFF);
+	glyphs.invalidate(0x17);
+	glyphs.update(bus, 0x4800);
+	BOOST_CHECK_EQUAL(glyphs.glyph(2)[0], 0x00);
+}
+
+BOOST_AUTO_TEST_CASE(test_dirty_bitmap)
+{
+	DirtyBitmap dirty(100);
+	BOOST_CHECK(dirty.any());
+	BOOST_CHECK(dirty.test(0));
+	BOOST_CHECK(dirty.test(99));
+
+	dirty.clear();
+	BOOST_CHECK(!dirty.any());
+	dirty.mark(70);
+	BOOST_CHECK(dirty.any());
+	BOOST_CHECK(dirty.test(70));
+	BOOST_CHECK(!dirty.test(69));
+	BOOST_CHECK(!dirty.test(71));
+
+	// Glyphs report which were expanded by the last update.
+	Ram ram(64 * 1024);
+	DirectAddressBus bus(ram);
+	GlyphCache glyphs(1);
+	BOOST_CHECK(glyphs.update(bus, 0x4800));
+	BOOST_CHECK(glyphs.wasRebuilt(200));
+	BOOST_CHECK(!glyphs.update(bus, 0x4800));
+	BOOST_CHECK(!glyphs.wasRebuilt(200));
+	glyphs.invalidate(200 * 8 + 3);
+	BOOST_CHECK(glyphs.update(bus, 0x4800));
+	BOOST_CHECK(glyphs.wasRebuilt(200));
+	BOOST_CHECK(!glyphs.wasRebuilt(201));
+}
+
+BOOST_AUTO_TEST_CASE(test_sprite_layer)
+{
+	// Sprite 0 has its top corners set, sprite 1 is solid.
+	std::uint8_t rom[64] = {};
+	rom[0] = 0x80;
+	rom[16] = 0x01;
+	for (int i = 32; i < 64; ++i) {
+		rom[i] = 0xFF;
+	}
+	SpriteLayer sprites(rom, sizeof(rom), 1);
+	sprites.setColour(0, 0xAA);
+	sprites.setColour(1, 0x55);
+
+	// Sprite 1 shows sprite 0 in the top left corner, sprite 2 shows sprite 1.
+	sprites.writeXPos(0, 232);
+	sprites.writeYPos(0, 240);
+	sprites.writeXPos(1, 0);
+	sprites.writeYPos(1, 0);
+	sprites.writeSpriteNo(0x10);
+	BOOST_CHECK_EQUAL(sprites.screenX(0), 0);
+	BOOST_CHECK_EQUAL(sprites.screenY(0), 0);
+	BOOST_CHECK_EQUAL(sprites.screenX(1), 232);
+	BOOST_CHECK_EQUAL(sprites.code(1), 1);
+
+	DirtyBitmap cells(32 * 32);
+	cells.clear();
+	BOOST_CHECK(sprites.markCells(cells));
+	BOOST_CHECK(cells.test(0));
+	BOOST_CHECK(cells.test(33));
+	BOOST_CHECK(!cells.test(2));
+	BOOST_CHECK(cells.test(30 * 32 + 29));
+
+	std::vector<std::uint8_t> pixels(256 * 256, 0x11);
+	sprites.draw(pixels.data(), 256);
+	BOOST_CHECK_EQUAL(pixels[0], 0xAA);
+	BOOST_CHECK_EQUAL(pixels[1], 0x11);
+	BOOST_CHECK_EQUAL(pixels[15], 0xAA);
+	BOOST_CHECK_EQUAL(pixels[240 * 256 + 232], 0x55);
+	BOOST_CHECK_EQUAL(pixels[255 * 256 + 247], 0x55);
+	BOOST_CHECK_EQUAL(pixels[255 * 256 + 248], 0x11);
+
+	// Nothing changed and nothing under the sprites needs redrawing.
+	cells.clear();
+	BOOST_CHECK(!sprites.markCells(cells));
+	BOOST_CHECK(!cells.any());
+
+	// A redrawn cell under a sprite means drawing the sprites again.
+	cells.mark(31 * 32 + 29);
+	BOOST_CHECK(sprites.markCells(cells));
+	BOOST_CHECK(cells.test(0));
+
+	// Moving a sprite part off the screen redraws where it was and clips where it is.
+	sprites.draw(pixels.data(), 256);
+	cells.clear();
+	sprites.writeXPos(0, 240);
+	BOOST_CHECK_EQUAL(sprites.screenX(0), -8);
+	BOOST_CHECK(sprites.markCells(cells));
+	BOOST_CHECK(cells.test(1));
+	std::fill(pixels.begin(), pixels.end(), 0x11);
+	sprites.draw(pixels.data(), 256);
+	BOOST_CHECK_EQUAL(pixels[7], 0xAA);
+	BOOST_CHECK_EQUAL(pixels[0], 0x11);
+}
+
+BOOST_AUTO_TEST_CASE(test_collision_detector)
+{
+	// Sprite 0 has its top corners set, sprite 1 is solid.
+	std::uint8_t rom[64] = {};
+	rom[0] = 0x80;
+	rom[16] = 0x01;
+	for (int i = 32; i < 64; ++i) {
+		rom[i] = 0xFF;
+	}
+	SpriteLayer sprites(rom, sizeof(rom), 1);
+	CollisionDetector collisions(rom, sizeof(rom));
+
+	// One background pixel at (21, 11), in glyph 1 at cell (2, 1).
+	std::uint8_t charCodes[0x400] = {};
+	std::uint8_t charBits[0x800] = {};
+	charCodes[1 * 32 + 2] = 1;
+	charBits[1 * 8 + 3] = 0x80 >> 5;
+
+	// Sprite 1 is solid at (10, 0), sprite 2 has a corner at (20, 4).
+	sprites.writeSpriteNo(0x01);
+	sprites.writeXPos(0, 232 - 10);
+	sprites.writeYPos(0, 240 - 0);
+	sprites.writeXPos(1, 232 - 20);
+	sprites.writeYPos(1, 240 - 4);
+
+	CollisionDetector::Collision found[CollisionDetector::NUM_COLLISIONS];
+	std::uint8_t status = collisions.check(sprites, charCodes, charBits, found);
+	BOOST_CHECK_EQUAL(status, CollisionDetector::statusBit(CollisionDetector::SPRITE1_BACKGROUND) | CollisionDetector::statusBit(CollisionDetector::SPRITE1_SPRITE2));
+	BOOST_CHECK(found[CollisionDetector::SPRITE1_BACKGROUND].hit);
+	BOOST_CHECK_EQUAL(found[CollisionDetector::SPRITE1_BACKGROUND].x, 21);
+	BOOST_CHECK_EQUAL(found[CollisionDetector::SPRITE1_BACKGROUND].y, 11);
+	BOOST_CHECK(!found[CollisionDetector::SPRITE2_BACKGROUND].hit);
+	BOOST_CHECK_EQUAL(found[CollisionDetector::SPRITE1_SPRITE2].x, 20);
+	BOOST_CHECK_EQUAL(found[CollisionDetector::SPRITE1_SPRITE2].y, 4);
+
+	// Against a pixel by pixel check, sprites partly off every edge included.
+	std::uint32_t seed = 12345;
+	auto random = [&seed]() { seed = seed * 1103515245 + 12345; return (seed >> 16) & 0xFF; };
+	for (int i = 0; i < 0x400; ++i) {
+		charCodes[i] = static_cast<std::uint8_t>(random() & 0x03);
+	}
+	for (int i = 0; i < 4 * 8; ++i) {
+		charBits[i] = static_cast<std::uint8_t>(random() & random() & random());
+	}
+	std::uint8_t patterns[64];
+	for (auto& bits : patterns) {
+		bits = static_cast<std::uint8_t>(random() & random());
+	}
+	SpriteLayer randomSprites(patterns, sizeof(patterns), 1);
+	CollisionDetector randomCollisions(patterns, sizeof(patterns));
+
+	auto spritePixel = [&](int sprite, int x, int y) {
+		int col = x - randomSprites.screenX(sprite);
+		int row = y - randomSprites.screenY(sprite);
+		if (col < 0 || col >= 16 || row < 0 || row >= 16) {
+			return false;
+		}
+		std::uint8_t bits = patterns[randomSprites.code(sprite) * 32 + row + (col >= 8 ? 16 : 0)];
+		return (bits & (0x80 >> (col & 7))) != 0;
+	};
+	auto backgroundPixel = [&](int x, int y) {
+		std::uint8_t bits = charBits[charCodes[(y / 8) * 32 + x / 8] * 8 + (y & 7)];
+		return (bits & (0x80 >> (x & 7))) != 0;
+	};
+
+	for (int pass = 0; pass < 300; ++pass) {
+		randomSprites.writeSpriteNo(static_cast<std::uint8_t>(random()));
+		randomSprites.writeXPos(0, static_cast<std::uint8_t>(random()));
+		randomSprites.writeYPos(0, static_cast<std::uint8_t>(random()));
+		// Keep sprite 2 near sprite 1 half the time so that they meet.
+		if ((pass & 1) != 0) {
+			randomSprites.writeXPos(1, static_cast<std::uint8_t>(232 - randomSprites.screenX(0) + (random() & 0x1F) - 0x10));
+			randomSprites.writeYPos(1, static_cast<std::uint8_t>(240 - randomSprites.screenY(0) + (random() & 0x1F) - 0x10));
+		}
+		else {
+			randomSprites.writeXPos(1, static_cast<std::uint8_t>(random()));
+			randomSprites.writeYPos(1, static_cast<std::uint8_t>(random()));
+		}
+
+		CollisionDetector::Collision expected[CollisionDetector::NUM_COLLISIONS];
+		for (int y = 0; y < 256; ++y) {
+			for (int x = 0; x < 256; ++x) {
+				bool sprite1 = spritePixel(0, x, y);
+				bool sprite2 = spritePixel(1, x, y);
+				bool background = backgroundPixel(x, y);
+				bool hits[] = { sprite1 && background, sprite2 && background, sprite1 && sprite2 };
+				for (int collision = 0; collision < CollisionDetector::NUM_COLLISIONS; ++collision) {
+					if (hits[collision] && !expected[collision].hit) {
+						expected[collision].hit = true;
+						expected[collision].x = x;
+						expected[collision].y = y;
+					}
+				}
+			}
+		}
+
+		randomCollisions.check(randomSprites, charCodes, charBits, found);
+		for (int collision = 0; collision < CollisionDetector::NUM_COLLISIONS; ++collision) {
+			BOOST_CHECK_EQUAL(found[collision].hit, expected[collision].hit);
+			BOOST_CHECK_EQUAL(found[collision].x, expected[collision].x);
+			BOOST_CHECK_EQUAL(found[collision].y, expected[collision].y);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_sprite_disabled)
+{
+	// Sprite 0 has its top corners set, sprite 1 is solid.
+	std::uint8_t rom[64] = {};
+	rom[0] = 0x80;
+	rom[16] = 0x01;
+	for (int i = 32; i < 64; ++i) {
+		rom[i] = 0xFF;
+	}
+	SpriteLayer sprites(rom, sizeof(rom), 1);
+	sprites.setColour(0, 0xAA);
+	sprites.setColour(1, 0x55);
+	CollisionDetector collisions(rom, sizeof(rom));
+
+	// Both sprites are solid, sprite 1 at (0, 0) and sprite 2 at (8, 0), and the top row
+	// of every cell is set, so all three collisions happen.
+	std::uint8_t charCodes[0x400] = {};
+	std::uint8_t charBits[0x800] = {};
+	charBits[0] = 0xFF;
+	sprites.writeSpriteNo(0x11);
+	sprites.writeXPos(0, 232);
+	sprites.writeYPos(0, 240);
+	sprites.writeXPos(1, 232 - 8);
+	sprites.writeYPos(1, 240);
+
+	std::vector<std::uint8_t> pixels(256 * 256, 0x11);
+	DirtyBitmap cells(32 * 32);
+	cells.clear();
+	BOOST_CHECK(sprites.markCells(cells));
+	sprites.draw(pixels.data(), 256);
+	BOOST_CHECK_EQUAL(pixels[0], 0xAA);
+	BOOST_CHECK_EQUAL(pixels[8], 0xAA);
+	BOOST_CHECK_EQUAL(pixels[16], 0x55);
+
+	CollisionDetector::Collision found[CollisionDetector::NUM_COLLISIONS];
+	BOOST_CHECK_EQUAL(collisions.check(sprites, charCodes, charBits, found), 0x1C);
+
+	// Bit 7 of the enable register hides sprite 1. Where it was is redrawn, it isn't
+	// drawn again and it collides with nothing.
+	sprites.writeEnable(0x80);
+	BOOST_CHECK(sprites.visible(1));
+	BOOST_CHECK(!sprites.visible(0));
+	cells.clear();
+	BOOST_CHECK(sprites.markCells(cells));
+	BOOST_CHECK(cells.test(0));
+	std::fill(pixels.begin(), pixels.end(), 0x11);
+	sprites.draw(pixels.data(), 256);
+	BOOST_CHECK_EQUAL(pixels[0], 0x11);
+	BOOST_CHECK_EQUAL(pixels[8], 0x55);
+	BOOST_CHECK_EQUAL(collisions.check(sprites, charCodes, charBits, found), CollisionDetector::statusBit(CollisionDetector::SPRITE2_BACKGROUND));
+	BOOST_CHECK(!found[CollisionDetector::SPRITE1_BACKGROUND].hit);
+	BOOST_CHECK(!found[CollisionDetector::SPRITE1_SPRITE2].hit);
+
+	// Once hidden, a redrawn cell under it doesn't mean drawing the sprites again.
+	cells.clear();
+	cells.mark(0);
+	BOOST_CHECK(!sprites.markCells(cells));
+}
+
+BOOST_AUTO_TEST_CASE(test_frame_buffer)
+{
+	FrameBuffer argb(100, 3, FrameBuffer::Format::ARGB32);
+	BOOST_CHECK_EQUAL(argb.bytesPerPixel(), 4);
+	BOOST_CHECK_EQUAL(argb.pitch(), 448);
+	BOOST_CHECK_EQUAL(argb.mapRGB(0xFF, 0x80, 0x01), 0xFFFF8001u);
+	for (int y = 0; y < argb.height(); ++y) {
+		BOOST_CHECK_EQUAL(reinterpret_cast<std::uintptr_t>(argb.row(y)) % FrameBuffer::ROW_ALIGNMENT, 0u);
+		BOOST_CHECK_EQUAL(argb.row(y)[0], 0);
+	}
+
+	FrameBuffer indexed(100, 3, FrameBuffer::Format::INDEXED8);
+	BOOST_CHECK_EQUAL(indexed.bytesPerPixel(), 1);
+	BOOST_CHECK_EQUAL(indexed.pitch(), 128);
+	BOOST_CHECK_EQUAL(indexed.mapRGB(0xFF, 0xFF, 0xFF), 0xFFu);
+	BOOST_CHECK_EQUAL(indexed.mapRGB(0xFF, 0x00, 0x00), 0xE0u);
+	BOOST_CHECK_EQUAL(indexed.mapRGB(0x00, 0xFF, 0x00), 0x1Cu);
+	BOOST_CHECK_EQUAL(indexed.mapRGB(0x00, 0x00, 0xFF), 0x03u);
+
+	// The hash covers the pixels but not the padding after each row.
+	std::uint64_t blank = indexed.hash();
+	indexed.row(1)[100] = 0x55;
+	BOOST_CHECK_EQUAL(indexed.hash(), blank);
+	indexed.row(1)[99] = 0x55;
+	BOOST_CHECK(indexed.hash() != blank);
+
+	// The sidetrac layers draw into it headless.
+	Ram ram(64 * 1024);
+	DirectAddressBus bus(ram);
+	ram.bytes[0x4808] = 0x81;
+	GlyphCache glyphs(indexed.bytesPerPixel());
+	glyphs.update(bus, 0x4800);
+	std::memcpy(indexed.row(0), glyphs.glyph(1), glyphs.rowBytes());
+	BOOST_CHECK_EQUAL(indexed.row(0)[0], 0xFF);
+	BOOST_CHECK_EQUAL(indexed.row(0)[1], 0x00);
+	BOOST_CHECK_EQUAL(indexed.row(0)[7], 0xFF);
+}